@@ -0,0 +1,366 @@
+// Benchmarks for KDTree and FlatKDTree. Every result is printed as one JSON object per line so runs can be
+// saved (./run_bench > bench_output.txt) and compared between versions.
+//
+// Usage: ./run_bench [--max-points N] [--queries Q] [--seed S] [--threads T]
+//
+// Sizes go from 1e3 up to --max-points by factors of 10, 1e7 by default; pass a smaller --max-points for a
+// quick run. For every dataset the first queries are also answered by a linear scan, and each structure's
+// answers are checked against it: a "check_*" result is 1 when they all match and 0 otherwise, and any
+// failed check makes the run exit with status 1.
+//
+// --threads also times KDTree::build on T threads (0 for one per core) as parallel_build_ms, with its speedup
+// over build_ms as parallel_build_speedup and the resolved thread count as parallel_build_threads, and sets the
+// thread count of FlatKDTree::allNearestNeighbors (all_nn_ms) and KDTree::distanceJoin (join_ms).
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../code/KDTree.h"
+#include "../code/FlatKDTree.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+struct BenchConfig {
+    size_t maxPoints;
+    size_t queries;
+    size_t maxInserts;
+    unsigned int seed;
+    unsigned int threads;
+};
+
+double elapsedMs(Clock::time_point start) {
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+double elapsedNs(Clock::time_point start) {
+    return chrono::duration<double, nano>(Clock::now() - start).count();
+}
+
+/**
+ * @brief generates a reproducible dataset of count points in [0, 1000)^dimensions
+ * 
+ * @param kind (const string&) "uniform", "clustered" (gaussian blobs around 32 centers) or "sorted" (uniform
+ * sorted on every axis in turn, the worst case for insertNode)
+ */
+vector<vector<double>> generateDataset(const string &kind, unsigned int dimensions, size_t count, unsigned int seed) {
+    mt19937_64 rng(seed);
+    uniform_real_distribution<double> uniform(0.0, 1000.0);
+    vector<vector<double>> points(count, vector<double>(dimensions));
+
+    if (kind == "clustered") {
+        vector<vector<double>> centers(32, vector<double>(dimensions));
+        for (vector<double> &center : centers) {
+            for (double &value : center) {
+                value = uniform(rng);
+            }
+        }
+        normal_distribution<double> spread(0.0, 10.0);
+        uniform_int_distribution<size_t> pick(0, centers.size() - 1);
+        for (vector<double> &point : points) {
+            const vector<double> &center = centers[pick(rng)];
+            for (unsigned int d = 0; d < dimensions; d++) {
+                point[d] = center[d] + spread(rng);
+            }
+        }
+        return points;
+    }
+
+    for (vector<double> &point : points) {
+        for (double &value : point) {
+            value = uniform(rng);
+        }
+    }
+    if (kind == "sorted") {
+        sort(points.begin(), points.end());
+    }
+    return points;
+}
+
+void printResult(const string &structure, const string &dataset, unsigned int dimensions, size_t points, const string &metric, double value) {
+    cout << "{\"structure\":\"" << structure << "\",\"dataset\":\"" << dataset << "\",\"dims\":" << dimensions
+         << ",\"points\":" << points << ",\"metric\":\"" << metric << "\",\"value\":" << value << "}" << endl;
+}
+
+// queries answered by a linear scan in every benchmark, so a fast but wrong structure cannot go unnoticed
+static const size_t CHECKED_QUERIES = 32;
+static size_t failedChecks = 0;
+
+/**
+ * ExpectedAnswers struct holds the linear scan answers for the first CHECKED_QUERIES queries: the distance
+ * to the nearest point and the number of points in the query's box (see makeBoxes)
+ */
+struct ExpectedAnswers {
+    vector<double> nearest;
+    vector<size_t> inRange;
+};
+
+/**
+ * @brief prints a correctness check as a result, 1 if it passed and 0 if it failed, and counts failures
+ */
+void printCheck(const string &structure, const string &dataset, unsigned int dimensions, size_t points, const string &metric, bool passed) {
+    printResult(structure, dataset, dimensions, points, metric, passed ? 1 : 0);
+    if (!passed) {
+        failedChecks++;
+        cerr << structure << " " << dataset << " " << dimensions << "D " << points << " points: " << metric << " failed" << endl;
+    }
+}
+
+bool sameDistance(double actual, double expected) {
+    return fabs(actual - expected) <= 1e-9 * max(1.0, expected);
+}
+
+void printLatencies(const string &structure, const string &dataset, unsigned int dimensions, size_t points, const string &metric, vector<double> &latencies) {
+    if (latencies.empty()) {
+        return;
+    }
+    sort(latencies.begin(), latencies.end());
+    double sum = 0.0;
+    for (double latency : latencies) {
+        sum += latency;
+    }
+    size_t last = latencies.size() - 1;
+    cout << "{\"structure\":\"" << structure << "\",\"dataset\":\"" << dataset << "\",\"dims\":" << dimensions
+         << ",\"points\":" << points << ",\"metric\":\"" << metric << "\",\"unit\":\"ns\""
+         << ",\"mean\":" << sum / latencies.size()
+         << ",\"p50\":" << latencies[last / 2]
+         << ",\"p90\":" << latencies[last * 9 / 10]
+         << ",\"p99\":" << latencies[last * 99 / 100]
+         << ",\"max\":" << latencies[last] << "}" << endl;
+}
+
+/**
+ * @brief query boxes centered on query points and covering about 0.1% of the data space
+ */
+void makeBoxes(const vector<vector<double>> &queries, unsigned int dimensions, vector<vector<double>> &minCorners, vector<vector<double>> &maxCorners) {
+    double halfSide = 500.0 * pow(1e-3, 1.0 / dimensions);
+    for (const vector<double> &query : queries) {
+        vector<double> minCorner(dimensions);
+        vector<double> maxCorner(dimensions);
+        for (unsigned int d = 0; d < dimensions; d++) {
+            minCorner[d] = query[d] - halfSide;
+            maxCorner[d] = query[d] + halfSide;
+        }
+        minCorners.push_back(minCorner);
+        maxCorners.push_back(maxCorner);
+    }
+}
+
+ExpectedAnswers bruteForceAnswers(unsigned int dimensions, const vector<vector<double>> &points, const vector<vector<double>> &queries) {
+    vector<vector<double>> sample(queries.begin(), queries.begin() + min(queries.size(), CHECKED_QUERIES));
+    vector<vector<double>> minCorners;
+    vector<vector<double>> maxCorners;
+    makeBoxes(sample, dimensions, minCorners, maxCorners);
+
+    ExpectedAnswers expected;
+    for (size_t i = 0; i < sample.size(); i++) {
+        double nearest = numeric_limits<double>::infinity();
+        size_t inRange = 0;
+        for (const vector<double> &point : points) {
+            double distance = 0.0;
+            bool inside = true;
+            for (unsigned int d = 0; d < dimensions; d++) {
+                double diff = point[d] - sample[i][d];
+                distance += diff * diff;
+                inside = inside && minCorners[i][d] <= point[d] && point[d] <= maxCorners[i][d];
+            }
+            nearest = min(nearest, distance);
+            inRange += inside ? 1 : 0;
+        }
+        expected.nearest.push_back(sqrt(nearest));
+        expected.inRange.push_back(inRange);
+    }
+    return expected;
+}
+
+void benchKDTree(const string &dataset, unsigned int dimensions, const vector<vector<double>> &points, const vector<vector<double>> &queries, const ExpectedAnswers &expected, const BenchConfig &config) {
+    const string structure = "KDTree";
+    size_t n = points.size();
+    KDTree tree(dimensions);
+
+    Clock::time_point start = Clock::now();
+    tree.build(points);
+    double buildMs = elapsedMs(start);
+    printResult(structure, dataset, dimensions, n, "build_ms", buildMs);
+    if (config.threads != 1) {
+        KDTree parallelTree(dimensions);
+        start = Clock::now();
+        parallelTree.build(points, config.threads);
+        double parallelBuildMs = elapsedMs(start);
+        printResult(structure, dataset, dimensions, n, "parallel_build_ms", parallelBuildMs);
+        printResult(structure, dataset, dimensions, n, "parallel_build_speedup", buildMs / parallelBuildMs);
+        printResult(structure, dataset, dimensions, n, "parallel_build_threads", resolveThreadCount(config.threads));
+    }
+    printResult(structure, dataset, dimensions, n, "height", tree.balanceReport().height);
+    printResult(structure, dataset, dimensions, n, "bytes_per_point", (double)tree.memoryBytes() / n);
+
+    vector<double> latencies;
+    latencies.reserve(queries.size());
+    for (const vector<double> &query : queries) {
+        start = Clock::now();
+        tree.kNearest(query, 1);
+        latencies.push_back(elapsedNs(start));
+    }
+    printLatencies(structure, dataset, dimensions, n, "nn_latency", latencies);
+
+    latencies.clear();
+    for (const vector<double> &query : queries) {
+        start = Clock::now();
+        tree.kNearest(query, 16);
+        latencies.push_back(elapsedNs(start));
+    }
+    printLatencies(structure, dataset, dimensions, n, "knn16_latency", latencies);
+
+    vector<vector<double>> minCorners;
+    vector<vector<double>> maxCorners;
+    makeBoxes(queries, dimensions, minCorners, maxCorners);
+    latencies.clear();
+    for (size_t i = 0; i < queries.size(); i++) {
+        start = Clock::now();
+        tree.rangeSearch(minCorners[i], maxCorners[i]);
+        latencies.push_back(elapsedNs(start));
+    }
+    printLatencies(structure, dataset, dimensions, n, "range_latency", latencies);
+
+    bool nearestMatches = true;
+    bool rangeMatches = true;
+    for (size_t i = 0; i < expected.nearest.size(); i++) {
+        nearestMatches = nearestMatches && sameDistance(tree.kNearest(queries[i], 1)[0].distance, expected.nearest[i]);
+        rangeMatches = rangeMatches && tree.rangeSearch(minCorners[i], maxCorners[i]).size() == expected.inRange[i];
+    }
+    printCheck(structure, dataset, dimensions, n, "check_nn", nearestMatches);
+    printCheck(structure, dataset, dimensions, n, "check_range", rangeMatches);
+
+    // epsilon join of the queries against the tree, epsilon sized for about 10 matches per query on uniform data
+    double epsilon = 500.0 * pow(10.0 / n, 1.0 / dimensions);
+    KDTree queryTree(dimensions);
+    queryTree.build(queries);
+    size_t matches = 0;
+    start = Clock::now();
+    for (const vector<double> &query : queries) {
+        matches += tree.radiusCount(query, epsilon);
+    }
+    printResult(structure, dataset, dimensions, n, "radius_loop_join_ms", elapsedMs(start));
+    atomic<size_t> joined(0);
+    start = Clock::now();
+    queryTree.distanceJoin(tree, epsilon, [&joined](Node *, Node *, double) {
+        joined++;
+    }, config.threads);
+    printResult(structure, dataset, dimensions, n, "join_ms", elapsedMs(start));
+    printResult(structure, dataset, dimensions, n, "join_pairs", joined.load());
+    printCheck(structure, dataset, dimensions, n, "check_join", joined.load() == matches);
+
+    // one by one insertion in dataset order from an empty tree, the shape sorted input degrades
+    size_t inserts = min(n, config.maxInserts);
+    KDTree incremental(dimensions);
+    start = Clock::now();
+    for (size_t i = 0; i < inserts; i++) {
+        incremental.setRoot(incremental.insertNode(points[i]));
+    }
+    printResult(structure, dataset, dimensions, inserts, "insert_per_sec", inserts / (elapsedMs(start) / 1000.0));
+    printResult(structure, dataset, dimensions, inserts, "insert_height", incremental.balanceReport().height);
+
+    start = Clock::now();
+    for (size_t i = 0; i < inserts; i++) {
+        incremental.setRoot(incremental.removeNode(points[i]));
+    }
+    printResult(structure, dataset, dimensions, inserts, "remove_per_sec", inserts / (elapsedMs(start) / 1000.0));
+}
+
+void benchFlatKDTree(const string &dataset, unsigned int dimensions, const vector<vector<double>> &points, const vector<vector<double>> &queries, const ExpectedAnswers &expected, const BenchConfig &config) {
+    const string structure = "FlatKDTree";
+    size_t n = points.size();
+
+    Clock::time_point start = Clock::now();
+    FlatKDTree tree(dimensions, points);
+    printResult(structure, dataset, dimensions, n, "build_ms", elapsedMs(start));
+    printResult(structure, dataset, dimensions, n, "bytes_per_point", (double)tree.memoryBytes() / n);
+
+    vector<double> latencies;
+    latencies.reserve(queries.size());
+    for (const vector<double> &query : queries) {
+        start = Clock::now();
+        tree.nearestNeighborSearch(query);
+        latencies.push_back(elapsedNs(start));
+    }
+    printLatencies(structure, dataset, dimensions, n, "nn_latency", latencies);
+
+    vector<vector<double>> minCorners;
+    vector<vector<double>> maxCorners;
+    makeBoxes(queries, dimensions, minCorners, maxCorners);
+    latencies.clear();
+    for (size_t i = 0; i < queries.size(); i++) {
+        start = Clock::now();
+        tree.rangeSearch(minCorners[i], maxCorners[i]);
+        latencies.push_back(elapsedNs(start));
+    }
+    printLatencies(structure, dataset, dimensions, n, "range_latency", latencies);
+
+    bool nearestMatches = true;
+    bool rangeMatches = true;
+    for (size_t i = 0; i < expected.nearest.size(); i++) {
+        nearestMatches = nearestMatches && sameDistance(tree.kNearest(queries[i], 1)[0].distance, expected.nearest[i]);
+        rangeMatches = rangeMatches && tree.rangeSearch(minCorners[i], maxCorners[i]).size() == expected.inRange[i];
+    }
+    printCheck(structure, dataset, dimensions, n, "check_nn", nearestMatches);
+    printCheck(structure, dataset, dimensions, n, "check_range", rangeMatches);
+
+    // nearest other point of every point: one root-down 2-NN search per point against the leaf-by-leaf self-join
+    start = Clock::now();
+    for (const vector<double> &point : points) {
+        tree.kNearest(point, 2);
+    }
+    printResult(structure, dataset, dimensions, n, "root_down_all_nn_ms", elapsedMs(start));
+    start = Clock::now();
+    tree.allNearestNeighbors(config.threads);
+    printResult(structure, dataset, dimensions, n, "all_nn_ms", elapsedMs(start));
+}
+
+int main(int argc, char **argv) {
+    BenchConfig config;
+    config.maxPoints = 10000000;
+    config.queries = 10000;
+    config.maxInserts = 10000;
+    config.seed = 42;
+    config.threads = 1;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        if (option == "--max-points") {
+            config.maxPoints = strtoull(argv[i + 1], nullptr, 10);
+        } else if (option == "--queries") {
+            config.queries = strtoull(argv[i + 1], nullptr, 10);
+        } else if (option == "--seed") {
+            config.seed = strtoul(argv[i + 1], nullptr, 10);
+        } else if (option == "--threads") {
+            config.threads = strtoul(argv[i + 1], nullptr, 10);
+        } else {
+            cerr << "Unknown option " << option << endl;
+            return 1;
+        }
+    }
+
+    const string datasets[] = {"uniform", "clustered", "sorted"};
+    const unsigned int dimensionCounts[] = {2, 3, 8};
+
+    for (size_t n = 1000; n <= config.maxPoints && n <= 10000000; n *= 10) {
+        for (const string &dataset : datasets) {
+            for (unsigned int dimensions : dimensionCounts) {
+                vector<vector<double>> points = generateDataset(dataset, dimensions, n, config.seed);
+                vector<vector<double>> queries = generateDataset("uniform", dimensions, config.queries, config.seed + 1);
+                ExpectedAnswers expected = bruteForceAnswers(dimensions, points, queries);
+                benchKDTree(dataset, dimensions, points, queries, expected, config);
+                benchFlatKDTree(dataset, dimensions, points, queries, expected, config);
+            }
+        }
+    }
+    return failedChecks == 0 ? 0 : 1;
+}
@@ -0,0 +1,396 @@
+#ifndef BUCKETTREE_H__
+#define BUCKETTREE_H__ //check for dup declarations
+
+#include "./DistanceKernels.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+/**
+ * BucketNode struct is one node of the preorder array FlatKDTree and CompactKDTree are built into, either an
+ * internal node or a leaf. An internal node (count == 0) splits on dimension depth % k: points with a value
+ * smaller than split are under left, the others under right, and either child can be NONE. The exception is
+ * a run of identical points larger than a leaf, which no value can split: it is cut in halves by index, and
+ * both sides of such a node hold the split value. A leaf (count > 0) holds at most the tree's leafSize point
+ * slots [first, first + count), whose coordinates start at slot first * k of the coordinate array, stored
+ * structure-of-arrays.
+ */
+struct BucketNode {
+    /**
+     * index of a missing child or point slot
+     */
+    static const int NONE = -1;
+
+    /**
+     * largest number of points a leaf bucket can hold
+     */
+    static const unsigned int MAX_LEAF_SIZE = 256;
+
+    double split;
+    int left;
+    int right;
+    unsigned int first;
+    unsigned int count;
+};
+
+/**
+ * DoubleLeaves struct is the leaf policy of coordinates stored as doubles: buckets are scanned in place.
+ */
+struct DoubleLeaves {
+    const double *coordinates;
+
+    const double *decode(const BucketNode &leaf, unsigned int k) {
+        return coordinates + (size_t)leaf.first * k;
+    }
+};
+
+/**
+ * BucketTree class holds the traversals shared by FlatKDTree and CompactKDTree over a built node array. Leaves
+ * is the storage policy: leaves.decode(leaf, k) returns the bucket's coordinates as doubles stored
+ * structure-of-arrays, either in place or decoded into a buffer, so every bucket is scanned by the kernels of
+ * DistanceKernels.h whatever type its coordinates are stored in. A BucketTree is a cheap view made for each
+ * query; the arrays it reads stay owned by the tree that made it.
+ *
+ * Leaf scans are given the whole bucket at once: nearest searches pass scan(leaf, distances) the squared
+ * distance of every point of the bucket and prune with the squared radius it returns, box searches pass
+ * scan(leaf, inside) the containment flag of every point.
+ */
+template <typename Leaves>
+class BucketTree {
+public:
+    BucketTree(unsigned int dimensions, const BucketNode *nodes, size_t nodeCount, const Leaves &leaves);
+
+    /**
+     * @brief get the root node, BucketNode::NONE if the tree is empty
+     */
+    int root();
+
+    /**
+     * @brief get the point slot holding a point equal to the given one, by descending the splits then scanning
+     * the bucket
+     *
+     * @param point (const double*) k coordinates, compared with the decoded values
+     * @return int slot of the found point or BucketNode::NONE if not found
+     */
+    int findSlot(const double *point);
+
+    /**
+     * @brief descends towards the target, then on the way back visits the other branch only if the splitting
+     * plane is closer than the current radius. With planeSlack, the distance to every plane is first reduced
+     * by planeSlack[axis], for trees whose stored values can be that far from the points they stand for.
+     *
+     * @param node (int) subtree to search
+     * @param target (const double*) k coordinates of the query
+     * @param planeSlack (const double*) k slacks, or nullptr for none
+     * @param radius (double&) squared pruning radius, updated with what every leaf scan returns
+     * @param scan (ScanLeaf&) called as scan(leaf, squared distances), returns the new squared radius
+     * @param depth (unsigned int) depth of node
+     */
+    template <typename ScanLeaf>
+    void searchNearest(int node, const double *target, const double *planeSlack, double &radius, ScanLeaf &scan, unsigned int depth);
+
+    /**
+     * @brief visits every bucket holding a point inside a k-dimensional box, bounds included. Subtrees whose
+     * side of the splitting plane lies outside the box are skipped.
+     *
+     * @param node (int) subtree to search
+     * @param minCorner (const double*) minimum value of the box on every dimension
+     * @param maxCorner (const double*) maximum value of the box on every dimension
+     * @param scan (ScanLeaf&) called as scan(leaf, inside) for buckets with at least one point inside
+     * @param depth (unsigned int) depth of node
+     */
+    template <typename ScanLeaf>
+    void searchBox(int node, const double *minCorner, const double *maxCorner, ScanLeaf &scan, unsigned int depth);
+
+private:
+    unsigned int k;
+    const BucketNode *nodes;
+    size_t nodeCount;
+    Leaves leaves;
+};
+
+template <typename Leaves>
+BucketTree<Leaves>::BucketTree(unsigned int k, const BucketNode *nodes, size_t nodeCount, const Leaves &leaves)
+    : k(k), nodes(nodes), nodeCount(nodeCount), leaves(leaves) {
+}
+
+template <typename Leaves>
+int BucketTree<Leaves>::root() {
+    return nodeCount == 0 ? BucketNode::NONE : 0;
+}
+
+template <typename Leaves>
+int BucketTree<Leaves>::findSlot(const double *point) {
+    int node = root();
+    unsigned int depth = 0;
+    while (node != BucketNode::NONE && nodes[node].count == 0) {
+        unsigned int d = depth % k;
+        node = point[d] < nodes[node].split ? nodes[node].left : nodes[node].right;
+        depth++;
+    }
+    if (node == BucketNode::NONE) {
+        return BucketNode::NONE;
+    }
+
+    const BucketNode &leaf = nodes[node];
+    const double *block = leaves.decode(leaf, k);
+    for (unsigned int i = 0; i < leaf.count; i++) {
+        bool isEqual = true;
+        for (unsigned int d = 0; d < k && isEqual; d++) {
+            isEqual = block[(size_t)d * leaf.count + i] == point[d];
+        }
+        if (isEqual) {
+            return (int)(leaf.first + i);
+        }
+    }
+    return BucketNode::NONE;
+}
+
+template <typename Leaves>
+template <typename ScanLeaf>
+void BucketTree<Leaves>::searchNearest(int node, const double *target, const double *planeSlack, double &radius, ScanLeaf &scan, unsigned int depth) {
+    if (node == BucketNode::NONE) {
+        return;
+    }
+
+    const BucketNode &current = nodes[node];
+    if (current.count > 0) {
+        double distances[BucketNode::MAX_LEAF_SIZE];
+        squaredDistancesSoA(leaves.decode(current, k), current.count, k, target, distances);
+        radius = scan(current, distances);
+        return;
+    }
+
+    unsigned int d = depth % k;
+    double currentDistToPlane = target[d] - current.split;
+    int nextBranch = currentDistToPlane < 0 ? current.left : current.right;
+    int otherBranch = currentDistToPlane < 0 ? current.right : current.left;
+
+    searchNearest(nextBranch, target, planeSlack, radius, scan, depth + 1);
+
+    double planeBound = planeSlack == nullptr ? currentDistToPlane : max(0.0, fabs(currentDistToPlane) - planeSlack[d]);
+    if (planeBound * planeBound < radius) {
+        searchNearest(otherBranch, target, planeSlack, radius, scan, depth + 1);
+    }
+}
+
+template <typename Leaves>
+template <typename ScanLeaf>
+void BucketTree<Leaves>::searchBox(int node, const double *minCorner, const double *maxCorner, ScanLeaf &scan, unsigned int depth) {
+    if (node == BucketNode::NONE) {
+        return;
+    }
+
+    const BucketNode &current = nodes[node];
+    if (current.count > 0) {
+        unsigned char inside[BucketNode::MAX_LEAF_SIZE];
+        if (inBoxSoA(leaves.decode(current, k), current.count, k, minCorner, maxCorner, inside) > 0) {
+            scan(current, inside);
+        }
+        return;
+    }
+
+    // the left subtree only holds values smaller than the split, the right subtree values greater or equal;
+    // under a node cutting a run of duplicates both sides hold the split value, so equality enters the left too
+    unsigned int d = depth % k;
+    if (minCorner[d] <= current.split) {
+        searchBox(current.left, minCorner, maxCorner, scan, depth + 1);
+    }
+    if (current.split <= maxCorner[d]) {
+        searchBox(current.right, minCorner, maxCorner, scan, depth + 1);
+    }
+}
+
+/**
+ * NearestSlotScan struct keeps the nearest point slot of the buckets a nearest search visits
+ */
+struct NearestSlotScan {
+    int best;
+    double bestDist;
+
+    double operator()(const BucketNode &leaf, const double *distances) {
+        for (unsigned int i = 0; i < leaf.count; i++) {
+            if (distances[i] < bestDist) {
+                best = (int)(leaf.first + i);
+                bestDist = distances[i];
+            }
+        }
+        return bestDist;
+    }
+};
+
+/**
+ * IdsInBoxScan struct collects the ids of the points a box search finds inside
+ */
+struct IdsInBoxScan {
+    const int *ids;
+    vector<int> &idsInRange;
+
+    void operator()(const BucketNode &leaf, const unsigned char *inside) {
+        for (unsigned int i = 0; i < leaf.count; i++) {
+            if (inside[i]) {
+                idsInRange.push_back(ids[leaf.first + i]);
+            }
+        }
+    }
+};
+
+/**
+ * BucketTreeBuilder class builds the preorder node array of a balanced tree with median splits. The splits
+ * are chosen on points, the values queries will see; store(point, axis) is called for every axis of every
+ * point of a new leaf, in structure-of-arrays order, to append that value to the coordinate array in the
+ * tree's own storage type.
+ */
+template <typename StoreValue>
+class BucketTreeBuilder {
+public:
+    BucketTreeBuilder(unsigned int dimensions, unsigned int leafSize, const double *points, vector<BucketNode> &nodes, vector<int> &ids, StoreValue store);
+
+    /**
+     * @brief builds the tree of points 0 to count - 1 into the node and id arrays
+     */
+    void build(size_t count);
+
+private:
+    unsigned int k;
+    unsigned int leafSize;
+    const double *points;
+    vector<BucketNode> &nodes;
+    vector<int> &ids;
+    StoreValue store;
+    vector<int> order;
+
+    int recurseBuild(size_t first, size_t last, unsigned int depth, unsigned int unsplitLevels);
+    int makeLeaf(size_t first, size_t last);
+};
+
+/**
+ * @brief builds a balanced tree with BucketTreeBuilder, deducing the type of store
+ */
+template <typename StoreValue>
+void buildBucketTree(unsigned int k, unsigned int leafSize, const double *points, size_t count, vector<BucketNode> &nodes, vector<int> &ids, StoreValue store) {
+    BucketTreeBuilder<StoreValue> builder(k, leafSize, points, nodes, ids, store);
+    builder.build(count);
+}
+
+template <typename StoreValue>
+BucketTreeBuilder<StoreValue>::BucketTreeBuilder(unsigned int k, unsigned int leafSize, const double *points, vector<BucketNode> &nodes, vector<int> &ids, StoreValue store)
+    : k(k), leafSize(leafSize), points(points), nodes(nodes), ids(ids), store(store) {
+}
+
+template <typename StoreValue>
+void BucketTreeBuilder<StoreValue>::build(size_t count) {
+    nodes.reserve(2 * (count / leafSize) + 1);
+    ids.reserve(count);
+
+    order.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = (int)i;
+    }
+    recurseBuild(0, count, 0, 0);
+}
+
+template <typename StoreValue>
+int BucketTreeBuilder<StoreValue>::makeLeaf(size_t first, size_t last) {
+    BucketNode leaf;
+    leaf.split = 0.0;
+    leaf.left = BucketNode::NONE;
+    leaf.right = BucketNode::NONE;
+    leaf.first = (unsigned int)ids.size();
+    leaf.count = (unsigned int)(last - first);
+
+    // structure-of-arrays: every value of axis 0 in the bucket, then every value of axis 1, ...
+    for (unsigned int d = 0; d < k; d++) {
+        for (size_t i = first; i < last; i++) {
+            store(order[i], d);
+        }
+    }
+    for (size_t i = first; i < last; i++) {
+        ids.push_back(order[i]);
+    }
+
+    nodes.push_back(leaf);
+    return (int)nodes.size() - 1;
+}
+
+template <typename StoreValue>
+int BucketTreeBuilder<StoreValue>::recurseBuild(size_t first, size_t last, unsigned int depth, unsigned int unsplitLevels) {
+    if (first >= last) {
+        return BucketNode::NONE;
+    }
+    if (last - first <= leafSize) {
+        return makeLeaf(first, last);
+    }
+
+    const double *points = this->points;
+    unsigned int d = depth % k;
+    unsigned int dims = k;
+    size_t mid = first + (last - first) / 2;
+
+    // unsplitLevels == k means every dimension of the remaining points holds a single value: they are duplicates,
+    // which no value can separate, so they are cut in halves by index until every half fits in a leaf
+    if (unsplitLevels >= k) {
+        int node = (int)nodes.size();
+        BucketNode runNode;
+        runNode.split = points[(size_t)order[first] * dims + d];
+        runNode.left = BucketNode::NONE;
+        runNode.right = BucketNode::NONE;
+        runNode.first = 0;
+        runNode.count = 0;
+        nodes.push_back(runNode);
+
+        int left = recurseBuild(first, mid, depth + 1, unsplitLevels);
+        int right = recurseBuild(mid, last, depth + 1, unsplitLevels);
+        nodes[node].left = left;
+        nodes[node].right = right;
+        return node;
+    }
+
+    nth_element(order.begin() + first, order.begin() + mid, order.begin() + last, [points, dims, d](int a, int b) {
+        return points[(size_t)a * dims + d] < points[(size_t)b * dims + d];
+    });
+
+    // points equal to the split must go right, so the left half is only the values strictly below the median
+    double median = points[(size_t)order[mid] * dims + d];
+    double split = median;
+    size_t splitIndex = partition(order.begin() + first, order.begin() + mid, [points, dims, d, median](int i) {
+        return points[(size_t)i * dims + d] < median;
+    }) - order.begin();
+
+    if (splitIndex == first) {
+        // the median is also the minimum: split right after the median-valued points instead
+        splitIndex = partition(order.begin() + first, order.begin() + last, [points, dims, d, median](int i) {
+            return points[(size_t)i * dims + d] <= median;
+        }) - order.begin();
+        if (splitIndex < last) {
+            split = points[(size_t)order[splitIndex] * dims + d];
+            for (size_t i = splitIndex + 1; i < last; i++) {
+                split = min(split, points[(size_t)order[i] * dims + d]);
+            }
+        } else {
+            splitIndex = first;
+        }
+    }
+
+    // nodes are laid out in preorder so a node's left child usually sits right after it
+    int node = (int)nodes.size();
+    BucketNode bucketNode;
+    bucketNode.split = split;
+    bucketNode.left = BucketNode::NONE;
+    bucketNode.right = BucketNode::NONE;
+    bucketNode.first = 0;
+    bucketNode.count = 0;
+    nodes.push_back(bucketNode);
+
+    unsigned int nextUnsplitLevels = splitIndex == first ? unsplitLevels + 1 : 0;
+    int left = recurseBuild(first, splitIndex, depth + 1, nextUnsplitLevels);
+    int right = recurseBuild(splitIndex, last, depth + 1, nextUnsplitLevels);
+    nodes[node].left = left;
+    nodes[node].right = right;
+    return node;
+}
+
+#endif
@@ -0,0 +1,493 @@
+#ifndef COMPACTKDTREE_H__
+#define COMPACTKDTREE_H__ //check for dup declarations
+
+#include "./BucketTree.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+using namespace std;
+
+/**
+ * CompactKDTree is a read-only FlatKDTree whose coordinates are stored in a narrower type to fit more points per
+ * cache line and per host. The node array, leaf buckets and structure-of-arrays layout are the same as
+ * FlatKDTree; only the packed coordinates change:
+ *  - CompactKDTree<float> rounds every coordinate to the nearest 32-bit float (4 bytes per axis);
+ *  - CompactKDTree<int16_t> and CompactKDTree<int32_t> quantize every axis to fixed point with a per-axis scale
+ *    and offset chosen from the bounding box of the input, so value = offset + scale * q (2 or 4 bytes per axis).
+ *
+ * The build and the traversals are the BucketTree ones FlatKDTree uses: every bucket a query reaches is decoded
+ * into doubles (DecodedLeaves) and scanned by the kernels of DistanceKernels.h. The tree is built and queried on
+ * the stored (decoded) values, so getNode, nearestNeighborSearch and rangeSearch are exact with respect to them.
+ * The largest difference between an input value and its stored value is recorded per axis (maxError); the
+ * overloads taking the full-precision input use it to widen their pruning and then answer exactly with respect
+ * to the input.
+ *
+ * Points are identified by their id: the index of the point in the input used to build the tree.
+ */
+template <typename Coordinate>
+class CompactKDTree {
+    static_assert(is_same<Coordinate, float>::value || (is_integral<Coordinate>::value && is_signed<Coordinate>::value),
+        "CompactKDTree stores float or signed integer coordinates");
+
+public:
+    /**
+     * id/index returned when there is no such point or node
+     */
+    static const int NONE = -1;
+
+    /**
+     * largest number of points a leaf bucket can hold
+     */
+    static const unsigned int MAX_LEAF_SIZE = BucketNode::MAX_LEAF_SIZE;
+
+    /**
+     * CompactNode is either an internal node or a leaf, laid out like FlatKDTree::FlatNode (see BucketNode). The
+     * split of an internal node is a stored (decoded) value; a leaf's coordinates start at coordinates[first * k].
+     */
+    typedef BucketNode CompactNode;
+
+    /**
+     * @brief Builds a balanced CompactKDTree from a set of points using median splits on the stored values.
+     *
+     * @param dimensions (unsigned int) The number of dimensions of each point. Must be greater than zero.
+     * @param points (const vector<vector<double>>&) points to store, each must have `dimensions` coordinates
+     * @param leafSize (unsigned int) maximum number of points per leaf bucket, between 1 and MAX_LEAF_SIZE
+     */
+    CompactKDTree(unsigned int dimensions, const vector<vector<double>> &points, unsigned int leafSize = 16);
+
+    /**
+     * @brief Builds a balanced CompactKDTree from points packed one after another in a single buffer.
+     *
+     * @param dimensions (unsigned int) The number of dimensions of each point. Must be greater than zero.
+     * @param coordinates (const double*) count * dimensions coordinates, point i starts at coordinates[i * dimensions]
+     * @param count (size_t) number of points in the buffer
+     * @param leafSize (unsigned int) maximum number of points per leaf bucket, between 1 and MAX_LEAF_SIZE
+     */
+    CompactKDTree(unsigned int dimensions, const double *coordinates, size_t count, unsigned int leafSize = 16);
+
+    /**
+     * @brief get number of dimensions of the tree
+     */
+    int getDimensions();
+
+    /**
+     * @brief get the maximum number of points per leaf bucket
+     */
+    unsigned int getLeafSize();
+
+    /**
+     * @brief get number of points stored in the tree
+     */
+    size_t size();
+
+    /**
+     * @brief get the number of bytes used by the node, coordinate and id arrays
+     */
+    size_t memoryBytes();
+
+    /**
+     * @brief get the scale of an axis: a stored value is offset + scale * q. 1 for float storage.
+     */
+    double getScale(unsigned int axis);
+
+    /**
+     * @brief get the offset of an axis: a stored value is offset + scale * q. 0 for float storage.
+     */
+    double getOffset(unsigned int axis);
+
+    /**
+     * @brief get the largest difference, on one axis, between an input value and its stored value
+     */
+    double maxError(unsigned int axis);
+
+    /**
+     * @brief get the id of a stored point equal to the given point once both are stored the same way, i.e.
+     * the point is rounded or quantized before being compared
+     *
+     * @param point (const vector<double>&) point to find in tree
+     * @return int id of the found point or NONE if not found
+     */
+    int getNode(const vector<double> &point);
+
+    /**
+     * @brief determines the point whose stored value is nearest to the target, same traversal as
+     * FlatKDTree::nearestNeighborSearch
+     *
+     * @param target (const vector<double>&) point to find the nearest neighbor of
+     * @return int id of the nearest point or NONE if the tree is empty
+     */
+    int nearestNeighborSearch(const vector<double> &target);
+
+    /**
+     * @brief determines the point nearest to the target at full precision. Subtrees and stored points are
+     * only skipped when they cannot be nearer than the best point once their values are moved by maxError;
+     * the remaining candidates are measured on the full-precision coordinates.
+     *
+     * @param target (const vector<double>&) point to find the nearest neighbor of
+     * @param fullPrecision (const double*) the coordinates the tree was built from, packed, point id at [id * k]
+     * @return int id of the nearest point or NONE if the tree is empty
+     */
+    int nearestNeighborSearch(const vector<double> &target, const double *fullPrecision);
+
+    /**
+     * @brief find all points whose stored value lies inside a k-dimensional box, bounds included
+     *
+     * @param minCorner (const vector<double>&) minimum value of the box on every dimension
+     * @param maxCorner (const vector<double>&) maximum value of the box on every dimension
+     * @return vector<int> ids of the points within the box
+     */
+    vector<int> rangeSearch(const vector<double> &minCorner, const vector<double> &maxCorner);
+
+    /**
+     * @brief find all points inside a k-dimensional box at full precision: the box is widened by maxError
+     * on every axis, then every candidate is checked on its full-precision coordinates
+     *
+     * @param minCorner (const vector<double>&) minimum value of the box on every dimension
+     * @param maxCorner (const vector<double>&) maximum value of the box on every dimension
+     * @param fullPrecision (const double*) the coordinates the tree was built from, packed, point id at [id * k]
+     * @return vector<int> ids of the points within the box
+     */
+    vector<int> rangeSearch(const vector<double> &minCorner, const vector<double> &maxCorner, const double *fullPrecision);
+
+private:
+    unsigned int k;
+    unsigned int leafSize;
+    vector<CompactNode> nodes;
+    vector<Coordinate> coordinates;
+    vector<int> ids;
+    vector<double> scales;
+    vector<double> offsets;
+    vector<double> errors;
+
+    /**
+     * DecodedLeaves struct is the leaf policy of CompactKDTree: a bucket's narrow values are decoded axis by
+     * axis into buffer, which the leaf kernels then scan. The buffer is owned by the query and has k * leafSize
+     * slots, enough for any bucket: points that collide once quantized are duplicates to the builder, which
+     * cuts their runs into leaves of at most leafSize points.
+     */
+    struct DecodedLeaves {
+        const Coordinate *coordinates;
+        const double *offsets;
+        const double *scales;
+        double *buffer;
+
+        const double *decode(const BucketNode &leaf, unsigned int k);
+    };
+
+    /**
+     * RefinedNearestScan struct keeps the point nearest to target at full precision. A point's full-precision
+     * value is within errorNorm of its stored value, so points whose stored distance is farther than the best
+     * by more than that are skipped without reading their full-precision coordinates.
+     */
+    struct RefinedNearestScan {
+        unsigned int k;
+        const int *ids;
+        const double *fullPrecision;
+        const double *target;
+        double errorNorm;
+        int best;
+        double bestDist;
+
+        double operator()(const BucketNode &leaf, const double *storedDistances);
+    };
+
+    void chooseEncoding(const double *points, size_t count);
+    Coordinate encode(double value, unsigned int axis);
+    double decode(Coordinate value, unsigned int axis);
+    void buildFromPacked(const double *points, size_t count);
+    void checkPoint(const vector<double> &point);
+    BucketTree<DecodedLeaves> buckets(vector<double> &buffer);
+};
+
+template <typename Coordinate>
+const int CompactKDTree<Coordinate>::NONE;
+
+template <typename Coordinate>
+const unsigned int CompactKDTree<Coordinate>::MAX_LEAF_SIZE;
+
+template <typename Coordinate>
+CompactKDTree<Coordinate>::CompactKDTree(unsigned int k, const vector<vector<double>> &points, unsigned int leafSize) {
+    if (k == 0) {
+        throw invalid_argument("Incorrect number of dimensions provided. Please enter a dimension greater than 0.");
+    }
+    if (leafSize == 0 || leafSize > MAX_LEAF_SIZE) {
+        throw invalid_argument("Incorrect leaf size provided. Please enter a leaf size between 1 and 256.");
+    }
+    this->k = k;
+    this->leafSize = leafSize;
+
+    vector<double> packed;
+    packed.reserve(points.size() * k);
+    for (const vector<double> &point : points) {
+        if (point.size() != k) {
+            throw invalid_argument("Incorrect number of dimensions in point. Every point must have the dimensions of the tree.");
+        }
+        packed.insert(packed.end(), point.begin(), point.end());
+    }
+    buildFromPacked(packed.data(), points.size());
+}
+
+template <typename Coordinate>
+CompactKDTree<Coordinate>::CompactKDTree(unsigned int k, const double *coordinates, size_t count, unsigned int leafSize) {
+    if (k == 0) {
+        throw invalid_argument("Incorrect number of dimensions provided. Please enter a dimension greater than 0.");
+    }
+    if (leafSize == 0 || leafSize > MAX_LEAF_SIZE) {
+        throw invalid_argument("Incorrect leaf size provided. Please enter a leaf size between 1 and 256.");
+    }
+    this->k = k;
+    this->leafSize = leafSize;
+    buildFromPacked(coordinates, count);
+}
+
+template <typename Coordinate>
+void CompactKDTree<Coordinate>::chooseEncoding(const double *points, size_t count) {
+    scales.assign(k, 1.0);
+    offsets.assign(k, 0.0);
+    if (is_floating_point<Coordinate>::value) {
+        return;
+    }
+
+    // centre every axis on its bounding box and spread the box over [-max, max] of the integer type
+    const double steps = 2.0 * (double)numeric_limits<Coordinate>::max();
+    for (unsigned int d = 0; d < k; d++) {
+        double low = numeric_limits<double>::infinity();
+        double high = -numeric_limits<double>::infinity();
+        for (size_t i = 0; i < count; i++) {
+            low = min(low, points[i * k + d]);
+            high = max(high, points[i * k + d]);
+        }
+        if (count == 0) {
+            continue;
+        }
+        if (!std::isfinite(low) || !std::isfinite(high)) {
+            throw invalid_argument("Quantized coordinates must be finite.");
+        }
+        offsets[d] = low + (high - low) / 2.0;
+        if (high > low) {
+            scales[d] = (high - low) / steps;
+        }
+    }
+}
+
+template <typename Coordinate>
+Coordinate CompactKDTree<Coordinate>::encode(double value, unsigned int axis) {
+    if (is_floating_point<Coordinate>::value) {
+        return (Coordinate)value;
+    }
+    // queries can lie outside the box the encoding was chosen for, so clamp instead of overflowing
+    double q = round((value - offsets[axis]) / scales[axis]);
+    double limit = (double)numeric_limits<Coordinate>::max();
+    return (Coordinate)max(-limit, min(limit, q));
+}
+
+template <typename Coordinate>
+double CompactKDTree<Coordinate>::decode(Coordinate value, unsigned int axis) {
+    return offsets[axis] + scales[axis] * (double)value;
+}
+
+template <typename Coordinate>
+void CompactKDTree<Coordinate>::buildFromPacked(const double *points, size_t count) {
+    if (count > (size_t)numeric_limits<int>::max()) {
+        throw invalid_argument("Too many points for a CompactKDTree.");
+    }
+    chooseEncoding(points, count);
+
+    // the tree is split on the stored values, so every query sees the same points the leaves hold
+    vector<Coordinate> encoded(count * k);
+    vector<double> decoded(count * k);
+    errors.assign(k, 0.0);
+    for (size_t i = 0; i < count; i++) {
+        for (unsigned int d = 0; d < k; d++) {
+            encoded[i * k + d] = encode(points[i * k + d], d);
+            decoded[i * k + d] = decode(encoded[i * k + d], d);
+            errors[d] = max(errors[d], fabs(decoded[i * k + d] - points[i * k + d]));
+        }
+    }
+
+    coordinates.reserve(count * k);
+    unsigned int dims = k;
+    vector<Coordinate> &stored = coordinates;
+    buildBucketTree(k, leafSize, decoded.data(), count, nodes, ids, [&encoded, dims, &stored](int point, unsigned int d) {
+        stored.push_back(encoded[(size_t)point * dims + d]);
+    });
+}
+
+template <typename Coordinate>
+const double *CompactKDTree<Coordinate>::DecodedLeaves::decode(const BucketNode &leaf, unsigned int k) {
+    // one streaming loop per axis, so the kernels scan plain doubles whatever the stored type
+    const Coordinate *block = coordinates + (size_t)leaf.first * k;
+    for (unsigned int d = 0; d < k; d++) {
+        const Coordinate *axis = block + (size_t)d * leaf.count;
+        double *out = buffer + (size_t)d * leaf.count;
+        double offset = offsets[d];
+        double scale = scales[d];
+        for (unsigned int i = 0; i < leaf.count; i++) {
+            out[i] = offset + scale * (double)axis[i];
+        }
+    }
+    return buffer;
+}
+
+template <typename Coordinate>
+BucketTree<typename CompactKDTree<Coordinate>::DecodedLeaves> CompactKDTree<Coordinate>::buckets(vector<double> &buffer) {
+    buffer.resize((size_t)k * leafSize);
+    DecodedLeaves leaves = {coordinates.data(), offsets.data(), scales.data(), buffer.data()};
+    return BucketTree<DecodedLeaves>(k, nodes.data(), nodes.size(), leaves);
+}
+
+template <typename Coordinate>
+void CompactKDTree<Coordinate>::checkPoint(const vector<double> &point) {
+    if (point.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in point. Every point must have the dimensions of the tree.");
+    }
+}
+
+template <typename Coordinate>
+int CompactKDTree<Coordinate>::getDimensions() {
+    return k;
+}
+
+template <typename Coordinate>
+unsigned int CompactKDTree<Coordinate>::getLeafSize() {
+    return leafSize;
+}
+
+template <typename Coordinate>
+size_t CompactKDTree<Coordinate>::size() {
+    return ids.size();
+}
+
+template <typename Coordinate>
+size_t CompactKDTree<Coordinate>::memoryBytes() {
+    return nodes.capacity() * sizeof(CompactNode) + coordinates.capacity() * sizeof(Coordinate) + ids.capacity() * sizeof(int);
+}
+
+template <typename Coordinate>
+double CompactKDTree<Coordinate>::getScale(unsigned int axis) {
+    return scales.at(axis);
+}
+
+template <typename Coordinate>
+double CompactKDTree<Coordinate>::getOffset(unsigned int axis) {
+    return offsets.at(axis);
+}
+
+template <typename Coordinate>
+double CompactKDTree<Coordinate>::maxError(unsigned int axis) {
+    return errors.at(axis);
+}
+
+template <typename Coordinate>
+int CompactKDTree<Coordinate>::getNode(const vector<double> &point) {
+    if (point.size() != k) {
+        return NONE;
+    }
+    vector<double> stored(k);
+    for (unsigned int d = 0; d < k; d++) {
+        stored[d] = decode(encode(point[d], d), d);
+    }
+
+    vector<double> buffer;
+    int slot = buckets(buffer).findSlot(stored.data());
+    return slot == NONE ? NONE : ids[slot];
+}
+
+template <typename Coordinate>
+int CompactKDTree<Coordinate>::nearestNeighborSearch(const vector<double> &target) {
+    checkPoint(target);
+    vector<double> buffer;
+    BucketTree<DecodedLeaves> tree = buckets(buffer);
+    NearestSlotScan nearest = {NONE, numeric_limits<double>::infinity()};
+    double radius = nearest.bestDist;
+
+    tree.searchNearest(tree.root(), target.data(), nullptr, radius, nearest, 0);
+    return nearest.best == NONE ? NONE : ids[nearest.best];
+}
+
+template <typename Coordinate>
+double CompactKDTree<Coordinate>::RefinedNearestScan::operator()(const BucketNode &leaf, const double *storedDistances) {
+    for (unsigned int i = 0; i < leaf.count; i++) {
+        double lowerBound = max(0.0, sqrt(storedDistances[i]) - errorNorm);
+        if (lowerBound * lowerBound >= bestDist) {
+            continue;
+        }
+        const double *point = &fullPrecision[(size_t)ids[leaf.first + i] * k];
+        double dist = 0.0;
+        for (unsigned int d = 0; d < k; d++) {
+            double diff = point[d] - target[d];
+            dist += diff * diff;
+        }
+        if (dist < bestDist) {
+            best = (int)(leaf.first + i);
+            bestDist = dist;
+        }
+    }
+    return bestDist;
+}
+
+template <typename Coordinate>
+int CompactKDTree<Coordinate>::nearestNeighborSearch(const vector<double> &target, const double *fullPrecision) {
+    checkPoint(target);
+    // a point's full-precision value is within errors[d] of its stored value on every axis d
+    double errorNorm = 0.0;
+    for (unsigned int d = 0; d < k; d++) {
+        errorNorm += errors[d] * errors[d];
+    }
+    errorNorm = sqrt(errorNorm);
+
+    vector<double> buffer;
+    BucketTree<DecodedLeaves> tree = buckets(buffer);
+    RefinedNearestScan nearest = {k, ids.data(), fullPrecision, target.data(), errorNorm, NONE, numeric_limits<double>::infinity()};
+    double radius = nearest.bestDist;
+
+    tree.searchNearest(tree.root(), target.data(), errors.data(), radius, nearest, 0);
+    return nearest.best == NONE ? NONE : ids[nearest.best];
+}
+
+template <typename Coordinate>
+vector<int> CompactKDTree<Coordinate>::rangeSearch(const vector<double> &minCorner, const vector<double> &maxCorner) {
+    if (minCorner.size() != k || maxCorner.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in range. Both corners must have the dimensions of the tree.");
+    }
+    vector<int> idsInRange;
+    IdsInBoxScan collect = {ids.data(), idsInRange};
+    vector<double> buffer;
+    BucketTree<DecodedLeaves> tree = buckets(buffer);
+    tree.searchBox(tree.root(), minCorner.data(), maxCorner.data(), collect, 0);
+    return idsInRange;
+}
+
+template <typename Coordinate>
+vector<int> CompactKDTree<Coordinate>::rangeSearch(const vector<double> &minCorner, const vector<double> &maxCorner, const double *fullPrecision) {
+    if (minCorner.size() != k || maxCorner.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in range. Both corners must have the dimensions of the tree.");
+    }
+    vector<double> widenedMin(k);
+    vector<double> widenedMax(k);
+    for (unsigned int d = 0; d < k; d++) {
+        widenedMin[d] = minCorner[d] - errors[d];
+        widenedMax[d] = maxCorner[d] + errors[d];
+    }
+    vector<int> candidates = rangeSearch(widenedMin, widenedMax);
+
+    vector<int> idsInRange;
+    for (int id : candidates) {
+        const double *point = &fullPrecision[(size_t)id * k];
+        bool inside = true;
+        for (unsigned int d = 0; d < k && inside; d++) {
+            inside = minCorner[d] <= point[d] && point[d] <= maxCorner[d];
+        }
+        if (inside) {
+            idsInRange.push_back(id);
+        }
+    }
+    return idsInRange;
+}
+
+#endif
@@ -0,0 +1,420 @@
+#include "ConcurrentKDTree.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+ConcurrentKDTree::VersionNode::VersionNode(PointView point, shared_ptr<const VersionNode> left, shared_ptr<const VersionNode> right)
+    : point(point.begin(), point.end()), left(move(left)), right(move(right)) {}
+
+/**
+ * children released by node destructors of this thread, waiting for the outermost destructor to release them
+ */
+static thread_local vector<shared_ptr<const ConcurrentKDTree::VersionNode>> deferredChildren;
+static thread_local bool releasingChildren = false;
+
+ConcurrentKDTree::VersionNode::~VersionNode() {
+    // releasing a child from here would run its destructor nested in this one, and so on down a long chain:
+    // hand the children to the outermost destructor of this thread, which releases them one at a time. Each
+    // node's children are only touched in its own destructor, which runs after its last owner let go.
+    if (left != nullptr) {
+        deferredChildren.push_back(move(left));
+    }
+    if (right != nullptr) {
+        deferredChildren.push_back(move(right));
+    }
+    if (releasingChildren) {
+        return;
+    }
+    releasingChildren = true;
+    while (!deferredChildren.empty()) {
+        shared_ptr<const VersionNode> child = move(deferredChildren.back());
+        deferredChildren.pop_back();
+        child.reset();
+    }
+    releasingChildren = false;
+}
+
+/**
+ * @brief creates a node that takes over the given children
+ */
+static shared_ptr<const ConcurrentKDTree::VersionNode> makeVersionNode(PointView point, shared_ptr<const ConcurrentKDTree::VersionNode> left, shared_ptr<const ConcurrentKDTree::VersionNode> right) {
+    return make_shared<ConcurrentKDTree::VersionNode>(point, move(left), move(right));
+}
+
+/**
+ * VersionBranch struct is a subtree waiting on the explicit stack of a snapshot query with its depth and the
+ * squared distance from the query to its region (0 if unknown)
+ */
+struct VersionBranch {
+    const ConcurrentKDTree::VersionNode *node;
+    unsigned int depth;
+    double bound;
+};
+
+static VersionBranch makeVersionBranch(const ConcurrentKDTree::VersionNode *node, unsigned int depth, double bound) {
+    VersionBranch branch = {node, depth, bound};
+    return branch;
+}
+
+PointView ConcurrentKDTree::VersionNode::getPoint() const {
+    return PointView(point);
+}
+
+ConcurrentKDTree::Snapshot::Snapshot(unsigned int k, shared_ptr<const VersionNode> root, size_t count) {
+    this->k = k;
+    this->root = root;
+    this->count = count;
+}
+
+const ConcurrentKDTree::VersionNode *ConcurrentKDTree::Snapshot::getRoot() const {
+    return root.get();
+}
+
+size_t ConcurrentKDTree::Snapshot::size() const {
+    return count;
+}
+
+void ConcurrentKDTree::Snapshot::checkDimensions(PointView point) const {
+    if (point.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in point. Every point must have the dimensions of the tree.");
+    }
+}
+
+double versionSquaredDistance(const double *a, const double *b, unsigned int k) {
+    double distance = 0.0;
+    for (unsigned int i = 0; i < k; i++) {
+        double diff = a[i] - b[i];
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+const ConcurrentKDTree::VersionNode *ConcurrentKDTree::Snapshot::getNode(PointView point) const {
+    checkDimensions(point);
+    const VersionNode *node = root.get();
+    unsigned int depth = 0;
+    while (node != nullptr) {
+        if (node->getPoint() == point) {
+            return node;
+        }
+        unsigned int d = depth % k;
+        node = point[d] < node->point[d] ? node->left.get() : node->right.get();
+        depth++;
+    }
+    return nullptr;
+}
+
+const ConcurrentKDTree::VersionNode *ConcurrentKDTree::Snapshot::nearestNeighborSearch(PointView query) const {
+    checkDimensions(query);
+    const VersionNode *best = nullptr;
+    double bestDist = numeric_limits<double>::infinity();
+    TraversalStack<VersionBranch> stack;
+    if (root != nullptr) {
+        stack.push(makeVersionBranch(root.get(), 0, 0.0));
+    }
+
+    while (!stack.empty()) {
+        VersionBranch branch = stack.pop();
+        if (branch.bound >= bestDist) {
+            continue;
+        }
+        const VersionNode *node = branch.node;
+        unsigned int depth = branch.depth;
+        while (node != nullptr) {
+            unsigned int d = depth % k;
+            double currentDist = versionSquaredDistance(node->point.data(), query.data(), k);
+            if (best == nullptr || currentDist < bestDist) {
+                best = node;
+                bestDist = currentDist;
+            }
+
+            double currentDistToPlane = query[d] - node->point[d];
+            const VersionNode *nextBranch = currentDistToPlane < 0 ? node->left.get() : node->right.get();
+            const VersionNode *otherBranch = currentDistToPlane < 0 ? node->right.get() : node->left.get();
+            if (otherBranch != nullptr) {
+                stack.push(makeVersionBranch(otherBranch, depth + 1, max(branch.bound, currentDistToPlane * currentDistToPlane)));
+            }
+            node = nextBranch;
+            depth++;
+        }
+    }
+    return best;
+}
+
+bool versionNeighborIsCloser(const ConcurrentKDTree::Neighbor &a, const ConcurrentKDTree::Neighbor &b) {
+    return a.distance < b.distance;
+}
+
+vector<ConcurrentKDTree::Neighbor> ConcurrentKDTree::Snapshot::kNearest(PointView query, unsigned int count) const {
+    checkDimensions(query);
+    vector<Neighbor> neighbors;
+    if (count == 0) {
+        return neighbors;
+    }
+    neighbors.reserve(count);
+    TraversalStack<VersionBranch> stack;
+    if (root != nullptr) {
+        stack.push(makeVersionBranch(root.get(), 0, 0.0));
+    }
+
+    // neighbors is a heap of squared distances while searching, its front is the farthest of the candidates
+    while (!stack.empty()) {
+        VersionBranch branch = stack.pop();
+        if (neighbors.size() == count && branch.bound >= neighbors.front().distance) {
+            continue;
+        }
+        const VersionNode *node = branch.node;
+        unsigned int depth = branch.depth;
+        while (node != nullptr) {
+            unsigned int d = depth % k;
+            double currentDist = versionSquaredDistance(node->point.data(), query.data(), k);
+            if (neighbors.size() < count) {
+                Neighbor neighbor = {node, currentDist};
+                neighbors.push_back(neighbor);
+                push_heap(neighbors.begin(), neighbors.end(), versionNeighborIsCloser);
+            } else if (currentDist < neighbors.front().distance) {
+                pop_heap(neighbors.begin(), neighbors.end(), versionNeighborIsCloser);
+                neighbors.back().node = node;
+                neighbors.back().distance = currentDist;
+                push_heap(neighbors.begin(), neighbors.end(), versionNeighborIsCloser);
+            }
+
+            double currentDistToPlane = query[d] - node->point[d];
+            const VersionNode *nextBranch = currentDistToPlane < 0 ? node->left.get() : node->right.get();
+            const VersionNode *otherBranch = currentDistToPlane < 0 ? node->right.get() : node->left.get();
+            if (otherBranch != nullptr) {
+                stack.push(makeVersionBranch(otherBranch, depth + 1, max(branch.bound, currentDistToPlane * currentDistToPlane)));
+            }
+            node = nextBranch;
+            depth++;
+        }
+    }
+
+    sort_heap(neighbors.begin(), neighbors.end(), versionNeighborIsCloser);
+    for (Neighbor &neighbor : neighbors) {
+        neighbor.distance = sqrt(neighbor.distance);
+    }
+    return neighbors;
+}
+
+vector<const ConcurrentKDTree::VersionNode *> ConcurrentKDTree::Snapshot::rangeSearch(PointView minCorner, PointView maxCorner) const {
+    checkDimensions(minCorner);
+    checkDimensions(maxCorner);
+    vector<const VersionNode *> nodesInRange;
+    TraversalStack<VersionBranch> stack;
+    if (root != nullptr) {
+        stack.push(makeVersionBranch(root.get(), 0, 0.0));
+    }
+
+    // the left subtree only holds values smaller than the node, the right subtree values greater or equal
+    while (!stack.empty()) {
+        VersionBranch branch = stack.pop();
+        const VersionNode *node = branch.node;
+        unsigned int d = branch.depth % k;
+        bool inRange = true;
+        for (unsigned int i = 0; i < k && inRange; i++) {
+            inRange = minCorner[i] <= node->point[i] && node->point[i] <= maxCorner[i];
+        }
+        if (inRange) {
+            nodesInRange.push_back(node);
+        }
+        if (node->right != nullptr && node->point[d] <= maxCorner[d]) {
+            stack.push(makeVersionBranch(node->right.get(), branch.depth + 1, 0.0));
+        }
+        if (node->left != nullptr && minCorner[d] < node->point[d]) {
+            stack.push(makeVersionBranch(node->left.get(), branch.depth + 1, 0.0));
+        }
+    }
+    return nodesInRange;
+}
+
+ConcurrentKDTree::ConcurrentKDTree(unsigned int k) {
+    if (k == 0) {
+        throw invalid_argument("Incorrect number of dimensions provided. Please enter a dimension greater than 0.");
+    }
+    this->k = k;
+    readEpoch.store(0);
+    activeReaders[0].store(0);
+    activeReaders[1].store(0);
+    published = make_shared<Snapshot>(k, nullptr, 0);
+    current.store(published.get());
+}
+
+unsigned int ConcurrentKDTree::getDimensions() {
+    return k;
+}
+
+void ConcurrentKDTree::checkDimensions(PointView point) {
+    if (point.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in point. Every point must have the dimensions of the tree.");
+    }
+}
+
+shared_ptr<const ConcurrentKDTree::Snapshot> ConcurrentKDTree::snapshot() const {
+    // while counted, the version current points to cannot be released: a writer waits for this count first
+    atomic<size_t> &readers = activeReaders[readEpoch.load() & 1];
+    readers.fetch_add(1);
+    shared_ptr<const Snapshot> latest = current.load()->shared_from_this();
+    readers.fetch_sub(1);
+    return latest;
+}
+
+void ConcurrentKDTree::publish(shared_ptr<const VersionNode> root, size_t count) {
+    shared_ptr<const Snapshot> next = make_shared<Snapshot>(k, move(root), count);
+    current.store(next.get());
+
+    // a reader that loaded the previous pointer was counted before the store above, in either slot: a reader can
+    // read the epoch, stall past a flip, then count itself in the slot it read. Each flip sends new readers to
+    // the other slot, so the slot left behind drains; after two flips both slots have drained since the store,
+    // nobody can still reach the previous version through current, and the writers' reference to it can go.
+    for (int phase = 0; phase < 2; phase++) {
+        unsigned int epoch = readEpoch.fetch_add(1);
+        while (activeReaders[epoch & 1].load() != 0) {
+            this_thread::yield();
+        }
+    }
+    published = move(next);
+}
+
+shared_ptr<const ConcurrentKDTree::VersionNode> ConcurrentKDTree::copyPath(vector<PathCopy> &path, shared_ptr<const VersionNode> bottom) {
+    // bottom up, each copy takes the copy made just below it as its changed child; the path is consumed
+    shared_ptr<const VersionNode> child = move(bottom);
+    for (size_t i = path.size(); i-- > 0;) {
+        PathCopy &step = path[i];
+        if (step.childOnLeft) {
+            child = makeVersionNode(step.pointSource->getPoint(), move(child), move(step.kept));
+        } else {
+            child = makeVersionNode(step.pointSource->getPoint(), move(step.kept), move(child));
+        }
+    }
+    return child;
+}
+
+void ConcurrentKDTree::insertNode(PointView point) {
+    checkDimensions(point);
+    lock_guard<mutex> lock(writeLock);
+    shared_ptr<const Snapshot> latest = published;
+
+    // the nodes on the path stay alive through latest while they are copied
+    vector<PathCopy> path;
+    const VersionNode *node = latest->root.get();
+    unsigned int depth = 0;
+    while (node != nullptr) {
+        unsigned int d = depth % k;
+        bool goLeft = point[d] < node->point[d];
+        PathCopy step = {node, goLeft ? node->right : node->left, goLeft};
+        path.push_back(step);
+        node = goLeft ? node->left.get() : node->right.get();
+        depth++;
+    }
+    publish(copyPath(path, makeVersionNode(point, nullptr, nullptr)), latest->count + 1);
+}
+
+const ConcurrentKDTree::VersionNode *ConcurrentKDTree::findMinimum(const VersionNode *node, unsigned int axis, unsigned int depth) {
+    const VersionNode *minimum = nullptr;
+    TraversalStack<VersionBranch> stack;
+    if (node != nullptr) {
+        stack.push(makeVersionBranch(node, depth, 0.0));
+    }
+    while (!stack.empty()) {
+        VersionBranch branch = stack.pop();
+        const VersionNode *current = branch.node;
+        // on the axis itself only the left subtree can hold smaller values, and only a node without one is a candidate
+        if (branch.depth % k == axis && current->left != nullptr) {
+            stack.push(makeVersionBranch(current->left.get(), branch.depth + 1, 0.0));
+            continue;
+        }
+        if (minimum == nullptr || current->point[axis] < minimum->point[axis]) {
+            minimum = current;
+        }
+        if (branch.depth % k != axis) {
+            if (current->right != nullptr) {
+                stack.push(makeVersionBranch(current->right.get(), branch.depth + 1, 0.0));
+            }
+            if (current->left != nullptr) {
+                stack.push(makeVersionBranch(current->left.get(), branch.depth + 1, 0.0));
+            }
+        }
+    }
+    return minimum;
+}
+
+bool ConcurrentKDTree::removeNode(PointView point) {
+    checkDimensions(point);
+    lock_guard<mutex> lock(writeLock);
+    shared_ptr<const Snapshot> latest = published;
+
+    // walk down to the point, then down the replacement chain: a removed inner node takes the point of the
+    // minimum of its subtree on its axis, which in turn is removed from that subtree. Every node passed is
+    // recorded with how its copy is rebuilt; the nodes and replacement points stay alive through latest.
+    vector<PathCopy> path;
+    vector<double> target(point.begin(), point.end());
+    bool removed = false;
+    const VersionNode *node = latest->root.get();
+    unsigned int depth = 0;
+    while (node != nullptr) {
+        unsigned int d = depth % k;
+        if (node->getPoint() == PointView(target)) {
+            removed = true;
+            if (node->left == nullptr && node->right == nullptr) {
+                break;
+            }
+            // without a right subtree the replacement comes from the left one, which becomes the right subtree
+            const VersionNode *subtree = node->right != nullptr ? node->right.get() : node->left.get();
+            const VersionNode *replacement = findMinimum(subtree, d, depth + 1);
+            PathCopy step = {replacement, node->right != nullptr ? node->left : nullptr, false};
+            path.push_back(step);
+            target = replacement->point;
+            node = subtree;
+            depth++;
+            continue;
+        }
+        bool goLeft = target[d] < node->point[d];
+        PathCopy step = {node, goLeft ? node->right : node->left, goLeft};
+        path.push_back(step);
+        node = goLeft ? node->left.get() : node->right.get();
+        depth++;
+    }
+
+    if (removed) {
+        publish(copyPath(path, nullptr), latest->count - 1);
+    }
+    return removed;
+}
+
+shared_ptr<const ConcurrentKDTree::VersionNode> ConcurrentKDTree::recurseBuild(vector<const vector<double> *> &points, size_t first, size_t last, unsigned int depth) {
+    if (first >= last) {
+        return nullptr;
+    }
+    unsigned int d = depth % k;
+    size_t mid = first + (last - first) / 2;
+
+    nth_element(points.begin() + first, points.begin() + mid, points.begin() + last, [d](const vector<double> *a, const vector<double> *b) {
+        return (*a)[d] < (*b)[d];
+    });
+
+    // points equal to the median must go right, so pull the smallest median-valued point up as the root
+    double median = (*points[mid])[d];
+    size_t splitIndex = partition(points.begin() + first, points.begin() + mid, [d, median](const vector<double> *p) {
+        return (*p)[d] < median;
+    }) - points.begin();
+    swap(points[splitIndex], points[mid]);
+
+    shared_ptr<const VersionNode> left = recurseBuild(points, first, splitIndex, depth + 1);
+    shared_ptr<const VersionNode> right = recurseBuild(points, splitIndex + 1, last, depth + 1);
+    return makeVersionNode(*points[splitIndex], left, right);
+}
+
+void ConcurrentKDTree::build(const vector<vector<double>> &points) {
+    vector<const vector<double> *> order;
+    order.reserve(points.size());
+    for (const vector<double> &point : points) {
+        checkDimensions(point);
+        order.push_back(&point);
+    }
+
+    shared_ptr<const VersionNode> root = recurseBuild(order, 0, order.size(), 0);
+    lock_guard<mutex> lock(writeLock);
+    publish(root, points.size());
+}
@@ -0,0 +1,198 @@
+#ifndef CONCURRENTKDTREE_H__
+#define CONCURRENTKDTREE_H__ //check for dup declarations
+
+#include "./PointView.h"
+#include "./TraversalStack.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * ConcurrentKDTree is a KDTree for many concurrent readers and occasional writers. It follows the same rules as
+ * KDTree (the dimension alternates with depth, smaller values go left, equal or greater values go right), but its
+ * nodes are never modified once published: insertNode and removeNode copy the nodes on the path they change
+ * (path copying) and share every other subtree with the previous version, then publish the new root atomically.
+ *
+ * Readers call snapshot() and query the returned Snapshot, an immutable version of the whole tree that no later
+ * write can change. Readers never lock or wait: writers are serialized by a mutex among themselves only, and
+ * publish each version through an atomic raw pointer. A reader announces itself in the reader count of the
+ * current epoch, loads the pointer and takes a shared_ptr to that version, then leaves the count. A writer
+ * stores the new pointer, then twice flips the epoch and waits for the readers counted in the epoch it left,
+ * before it drops its own reference to the previous version, so no reader can be left holding a freed pointer
+ * (a two-counter grace period, as in userspace read-copy-update). Only writers ever wait, and only for readers
+ * already inside snapshot(). A version, and the nodes only it uses, are freed when the last snapshot holding
+ * it is released.
+ *
+ * Queries, writes and the release of a version all loop over explicit stacks, so a degenerate tree built from
+ * sorted inserts cannot overflow the call stack.
+ */
+class ConcurrentKDTree {
+public:
+    /**
+     * VersionNode struct is an immutable node shared by every version of the tree that contains it. Nodes are
+     * only ever reached through shared_ptr<const VersionNode>, so nothing changes them once built.
+     */
+    struct VersionNode {
+        VersionNode(PointView point, shared_ptr<const VersionNode> left, shared_ptr<const VersionNode> right);
+        VersionNode(const VersionNode &) = delete;
+        VersionNode &operator=(const VersionNode &) = delete;
+
+        /**
+         * @brief releases the children one at a time instead of through nested destructor calls, so freeing a
+         * long chain of nodes cannot overflow the call stack
+         */
+        ~VersionNode();
+
+        PointView getPoint() const;
+
+        vector<double> point;
+        shared_ptr<const VersionNode> left;
+        shared_ptr<const VersionNode> right;
+    };
+
+    /**
+     * Neighbor struct is one result of a k-nearest neighbor search
+     */
+    struct Neighbor {
+        const VersionNode *node;
+        double distance;
+    };
+
+    /**
+     * Snapshot class is one published version of the tree. Its queries are read-only and safe to run from any
+     * number of threads; nodes they return stay valid as long as the snapshot is held.
+     */
+    class Snapshot : public enable_shared_from_this<Snapshot> {
+    public:
+        Snapshot(unsigned int dimensions, shared_ptr<const VersionNode> root, size_t count);
+
+        /**
+         * @brief get the root node of this version, nullptr if it is empty
+         */
+        const VersionNode *getRoot() const;
+
+        /**
+         * @brief get number of points in this version
+         */
+        size_t size() const;
+
+        /**
+         * @brief get a node holding a point equal to the given one
+         *
+         * @param point (PointView) point to find
+         * @return const VersionNode* found node or nullptr if not found
+         */
+        const VersionNode *getNode(PointView point) const;
+
+        /**
+         * @brief determines the stored point nearest to the query, a stored point equal to the query included
+         *
+         * @param query (PointView) point to find the nearest neighbor of
+         * @return const VersionNode* nearest node or nullptr if the version is empty
+         */
+        const VersionNode *nearestNeighborSearch(PointView query) const;
+
+        /**
+         * @brief finds the count stored points nearest to the query, sorted from nearest to farthest
+         *
+         * @param query (PointView) point to find the neighbors of
+         * @param count (unsigned int) number of neighbors to find
+         * @return vector<Neighbor> nearest nodes with their Euclidean distance to the query
+         */
+        vector<Neighbor> kNearest(PointView query, unsigned int count) const;
+
+        /**
+         * @brief find all points inside a k-dimensional box, bounds included
+         *
+         * @param minCorner (PointView) minimum value of the box on every dimension
+         * @param maxCorner (PointView) maximum value of the box on every dimension
+         * @return vector<const VersionNode*> nodes within the box
+         */
+        vector<const VersionNode *> rangeSearch(PointView minCorner, PointView maxCorner) const;
+
+    private:
+        friend class ConcurrentKDTree;
+        unsigned int k;
+        shared_ptr<const VersionNode> root;
+        size_t count;
+
+        void checkDimensions(PointView point) const;
+    };
+
+    /**
+     * @brief Constructs an empty ConcurrentKDTree.
+     *
+     * @param dimensions (unsigned int) The number of dimensions of the tree. Must be greater than zero.
+     */
+    ConcurrentKDTree(unsigned int dimensions);
+
+    /**
+     * @brief get number of dimensions of the tree
+     */
+    unsigned int getDimensions();
+
+    /**
+     * @brief get the latest published version of the tree. Never locks and never waits for a writer: a write
+     * in progress is simply not part of the returned snapshot.
+     *
+     * @return shared_ptr<const Snapshot> immutable version to query
+     */
+    shared_ptr<const Snapshot> snapshot() const;
+
+    /**
+     * @brief inserts a point by copying the nodes on its insertion path, then publishes the new version
+     *
+     * @param point (PointView) point to insert
+     */
+    void insertNode(PointView point);
+
+    /**
+     * @brief removes one point equal to the given one by copying the nodes on the paths it changes, the same
+     * replacement scheme as KDTree::removeNode, then publishes the new version
+     *
+     * @param point (PointView) point to remove
+     * @return bool whether a point was found and removed
+     */
+    bool removeNode(PointView point);
+
+    /**
+     * @brief replaces the content of the tree with a balanced tree built from the given points with median
+     * splits, then publishes it
+     *
+     * @param points (const vector<vector<double>>&) points to store, each must have the tree's dimensions
+     */
+    void build(const vector<vector<double>> &points);
+
+private:
+    unsigned int k;
+    mutex writeLock;
+    // the writers' reference to the latest version, only touched under writeLock
+    shared_ptr<const Snapshot> published;
+    // what readers load; it points into published
+    atomic<const Snapshot *> current;
+    // readers in the middle of snapshot(), counted in the slot of the epoch they started in
+    atomic<unsigned int> readEpoch;
+    mutable atomic<size_t> activeReaders[2];
+
+    /**
+     * PathCopy struct is one node on the path a write copies: the copy takes its point from pointSource, keeps
+     * kept as one child and gets the copy of the level below as the other child, on the left if childOnLeft
+     */
+    struct PathCopy {
+        const VersionNode *pointSource;
+        shared_ptr<const VersionNode> kept;
+        bool childOnLeft;
+    };
+
+    void checkDimensions(PointView point);
+    void publish(shared_ptr<const VersionNode> root, size_t count);
+    static shared_ptr<const VersionNode> copyPath(vector<PathCopy> &path, shared_ptr<const VersionNode> bottom);
+    const VersionNode *findMinimum(const VersionNode *node, unsigned int axis, unsigned int depth);
+    shared_ptr<const VersionNode> recurseBuild(vector<const vector<double> *> &points, size_t first, size_t last, unsigned int depth);
+};
+
+#endif
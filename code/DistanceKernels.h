@@ -0,0 +1,107 @@
+#ifndef DISTANCEKERNELS_H__
+#define DISTANCEKERNELS_H__ //check for dup declarations
+
+#include <cstddef>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Leaf kernels work on a block of count points stored structure-of-arrays: all values of axis 0, then all
+ * values of axis 1, and so on, so axis d of point i is block[d * count + i]. Every axis is one streaming loop
+ * over contiguous memory, processed 4 points at a time with AVX, 2 at a time with SSE2, and one at a time
+ * when neither is enabled at compile time.
+ */
+
+/**
+ * @brief computes the squared distance from query to every point of a block
+ * 
+ * @param block (const double*) count points stored structure-of-arrays
+ * @param count (unsigned int) number of points in the block
+ * @param k (unsigned int) number of dimensions
+ * @param query (const double*) k coordinates of the query point
+ * @param distances (double*) count slots receiving the squared distances
+ */
+inline void squaredDistancesSoA(const double *block, unsigned int count, unsigned int k, const double *query, double *distances) {
+    for (unsigned int i = 0; i < count; i++) {
+        distances[i] = 0.0;
+    }
+
+    for (unsigned int d = 0; d < k; d++) {
+        const double *axis = block + (size_t)d * count;
+        unsigned int i = 0;
+#if defined(__AVX__)
+        __m256d q4 = _mm256_set1_pd(query[d]);
+        for (; i + 4 <= count; i += 4) {
+            __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(axis + i), q4);
+            _mm256_storeu_pd(distances + i, _mm256_add_pd(_mm256_loadu_pd(distances + i), _mm256_mul_pd(diff, diff)));
+        }
+#elif defined(__SSE2__)
+        __m128d q2 = _mm_set1_pd(query[d]);
+        for (; i + 2 <= count; i += 2) {
+            __m128d diff = _mm_sub_pd(_mm_loadu_pd(axis + i), q2);
+            _mm_storeu_pd(distances + i, _mm_add_pd(_mm_loadu_pd(distances + i), _mm_mul_pd(diff, diff)));
+        }
+#endif
+        for (; i < count; i++) {
+            double diff = axis[i] - query[d];
+            distances[i] += diff * diff;
+        }
+    }
+}
+
+/**
+ * @brief determines which points of a block lie inside a box, bounds included
+ * 
+ * @param block (const double*) count points stored structure-of-arrays
+ * @param count (unsigned int) number of points in the block
+ * @param k (unsigned int) number of dimensions
+ * @param minCorner (const double*) minimum value of the box on every dimension
+ * @param maxCorner (const double*) maximum value of the box on every dimension
+ * @param inside (unsigned char*) count slots set to 1 for points inside the box and 0 otherwise
+ * @return unsigned int number of points inside the box
+ */
+inline unsigned int inBoxSoA(const double *block, unsigned int count, unsigned int k, const double *minCorner, const double *maxCorner, unsigned char *inside) {
+    for (unsigned int i = 0; i < count; i++) {
+        inside[i] = 1;
+    }
+
+    for (unsigned int d = 0; d < k; d++) {
+        const double *axis = block + (size_t)d * count;
+        unsigned int i = 0;
+#if defined(__AVX__)
+        __m256d min4 = _mm256_set1_pd(minCorner[d]);
+        __m256d max4 = _mm256_set1_pd(maxCorner[d]);
+        for (; i + 4 <= count; i += 4) {
+            __m256d value = _mm256_loadu_pd(axis + i);
+            int mask = _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(min4, value, _CMP_LE_OQ), _mm256_cmp_pd(value, max4, _CMP_LE_OQ)));
+            for (unsigned int j = 0; j < 4; j++) {
+                inside[i + j] &= (mask >> j) & 1;
+            }
+        }
+#elif defined(__SSE2__)
+        __m128d min2 = _mm_set1_pd(minCorner[d]);
+        __m128d max2 = _mm_set1_pd(maxCorner[d]);
+        for (; i + 2 <= count; i += 2) {
+            __m128d value = _mm_loadu_pd(axis + i);
+            int mask = _mm_movemask_pd(_mm_and_pd(_mm_cmple_pd(min2, value), _mm_cmple_pd(value, max2)));
+            inside[i] &= mask & 1;
+            inside[i + 1] &= (mask >> 1) & 1;
+        }
+#endif
+        for (; i < count; i++) {
+            inside[i] &= minCorner[d] <= axis[i] && axis[i] <= maxCorner[d];
+        }
+    }
+
+    unsigned int found = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        found += inside[i];
+    }
+    return found;
+}
+
+#endif
@@ -0,0 +1,175 @@
+#include "DynamicKDTree.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+const size_t DynamicKDTree::NO_ID;
+
+DynamicKDTree::DynamicKDTree(unsigned int k, size_t bufferSize, unsigned int leafSize) {
+    if (k == 0) {
+        throw invalid_argument("Incorrect number of dimensions provided. Please enter a dimension greater than 0.");
+    }
+    if (bufferSize == 0) {
+        throw invalid_argument("Incorrect buffer size provided. Please enter a buffer size greater than 0.");
+    }
+    if (leafSize == 0 || leafSize > FlatKDTree::MAX_LEAF_SIZE) {
+        throw invalid_argument("Incorrect leaf size provided. Please enter a leaf size between 1 and 256.");
+    }
+    this->k = k;
+    this->bufferSize = bufferSize;
+    this->leafSize = leafSize;
+    pointCount = 0;
+    buffer.reserve(bufferSize * k);
+    bufferIds.reserve(bufferSize);
+}
+
+int DynamicKDTree::getDimensions() {
+    return k;
+}
+
+size_t DynamicKDTree::size() {
+    return pointCount;
+}
+
+vector<size_t> DynamicKDTree::levelSizes() {
+    vector<size_t> sizes;
+    for (Level &level : levels) {
+        sizes.push_back(level.tree ? level.tree->size() : 0);
+    }
+    return sizes;
+}
+
+size_t DynamicKDTree::memoryBytes() {
+    size_t bytes = buffer.capacity() * sizeof(double) + bufferIds.capacity() * sizeof(size_t);
+    for (Level &level : levels) {
+        if (level.tree) {
+            bytes += level.tree->memoryBytes() + level.ids.capacity() * sizeof(size_t);
+        }
+    }
+    return bytes;
+}
+
+void DynamicKDTree::checkDimensions(const vector<double> &point) {
+    if (point.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in point. Every point must have the dimensions of the tree.");
+    }
+}
+
+size_t DynamicKDTree::insert(PointView point) {
+    if (point.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in point. Every point must have the dimensions of the tree.");
+    }
+    return insertBatch(point.data(), 1);
+}
+
+size_t DynamicKDTree::insertBatch(const double *coordinates, size_t batchCount) {
+    size_t firstId = pointCount;
+    for (size_t i = 0; i < batchCount; i++) {
+        buffer.insert(buffer.end(), coordinates + i * k, coordinates + (i + 1) * k);
+        bufferIds.push_back(pointCount);
+        pointCount++;
+        if (bufferIds.size() == bufferSize) {
+            flushBuffer();
+        }
+    }
+    return firstId;
+}
+
+void DynamicKDTree::flushBuffer() {
+    // carry the buffer up through the full levels, like incrementing a binary counter
+    vector<double> points;
+    vector<size_t> ids;
+    points.swap(buffer);
+    ids.swap(bufferIds);
+
+    size_t target = 0;
+    while (target < levels.size() && levels[target].tree) {
+        Level &level = levels[target];
+        size_t offset = ids.size();
+        points.resize((offset + level.tree->size()) * k);
+        level.tree->copyPoints(&points[offset * k]);
+        ids.insert(ids.end(), level.ids.begin(), level.ids.end());
+        level.tree.reset();
+        vector<size_t>().swap(level.ids);
+        target++;
+    }
+    if (target == levels.size()) {
+        levels.push_back(Level());
+    }
+
+    levels[target].tree.reset(new FlatKDTree(k, points.data(), ids.size(), leafSize));
+    levels[target].ids.swap(ids);
+
+    buffer.reserve(bufferSize * k);
+    bufferIds.reserve(bufferSize);
+}
+
+DynamicKDTree::Neighbor DynamicKDTree::nearestNeighborSearch(const vector<double> &query) {
+    vector<Neighbor> nearest = kNearest(query, 1);
+    if (nearest.empty()) {
+        Neighbor none = {NO_ID, numeric_limits<double>::infinity()};
+        return none;
+    }
+    return nearest[0];
+}
+
+static bool neighborIsCloser(const DynamicKDTree::Neighbor &a, const DynamicKDTree::Neighbor &b) {
+    return a.distance < b.distance;
+}
+
+vector<DynamicKDTree::Neighbor> DynamicKDTree::kNearest(const vector<double> &query, unsigned int count) {
+    checkDimensions(query);
+    vector<Neighbor> candidates;
+    if (count == 0) {
+        return candidates;
+    }
+
+    for (size_t i = 0; i < bufferIds.size(); i++) {
+        double distance = 0.0;
+        for (unsigned int d = 0; d < k; d++) {
+            double diff = buffer[i * k + d] - query[d];
+            distance += diff * diff;
+        }
+        Neighbor neighbor = {bufferIds[i], sqrt(distance)};
+        candidates.push_back(neighbor);
+    }
+    for (Level &level : levels) {
+        if (!level.tree) {
+            continue;
+        }
+        for (const FlatKDTree::Neighbor &found : level.tree->kNearest(query, count)) {
+            Neighbor neighbor = {level.ids[found.id], found.distance};
+            candidates.push_back(neighbor);
+        }
+    }
+
+    size_t kept = min((size_t)count, candidates.size());
+    partial_sort(candidates.begin(), candidates.begin() + kept, candidates.end(), neighborIsCloser);
+    candidates.resize(kept);
+    return candidates;
+}
+
+vector<size_t> DynamicKDTree::rangeSearch(const vector<double> &minCorner, const vector<double> &maxCorner) {
+    if (minCorner.size() != k || maxCorner.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in range. Both corners must have the dimensions of the tree.");
+    }
+    vector<size_t> idsInRange;
+    for (size_t i = 0; i < bufferIds.size(); i++) {
+        bool inside = true;
+        for (unsigned int d = 0; d < k && inside; d++) {
+            inside = minCorner[d] <= buffer[i * k + d] && buffer[i * k + d] <= maxCorner[d];
+        }
+        if (inside) {
+            idsInRange.push_back(bufferIds[i]);
+        }
+    }
+    for (Level &level : levels) {
+        if (!level.tree) {
+            continue;
+        }
+        for (int id : level.tree->rangeSearch(minCorner, maxCorner)) {
+            idsInRange.push_back(level.ids[id]);
+        }
+    }
+    return idsInRange;
+}
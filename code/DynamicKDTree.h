@@ -0,0 +1,134 @@
+#ifndef DYNAMICKDTREE_H__
+#define DYNAMICKDTREE_H__ //check for dup declarations
+
+#include "./FlatKDTree.h"
+#include "./PointView.h"
+#include <vector>
+#include <memory>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * DynamicKDTree is an insert-heavy index built with the logarithmic method (Bentley-Saxe). New points go to a
+ * small write buffer of bufferSize points that is scanned linearly. When the buffer is full it is turned into
+ * a static, balanced FlatKDTree: level i is either empty or holds exactly bufferSize * 2^i points, and like a
+ * binary counter the buffer merges with levels 0, 1, ... until it reaches an empty level, where the merged
+ * points are rebuilt into one tree. Every point is rebuilt O(log n) times, so an insertion costs amortized
+ * O(log^2 n), and every component stays perfectly balanced whatever the insertion order.
+ *
+ * Queries fan out over the buffer and every non-empty level and merge their results. Points are identified by
+ * an id, assigned sequentially by insert as in KDTree.
+ */
+class DynamicKDTree {
+public:
+    /**
+     * Neighbor struct is one result of a nearest neighbor query: the id of a point and its distance to the query
+     */
+    struct Neighbor {
+        size_t id;
+        double distance;
+    };
+
+    /**
+     * id returned when there is no such point
+     */
+    static const size_t NO_ID = (size_t)-1;
+
+    /**
+     * @brief Constructs an empty DynamicKDTree.
+     *
+     * @param dimensions (unsigned int) The number of dimensions of each point. Must be greater than zero.
+     * @param bufferSize (size_t) number of points collected before they are built into a tree, at least 1
+     * @param leafSize (unsigned int) maximum number of points per leaf bucket of the level trees
+     */
+    DynamicKDTree(unsigned int dimensions, size_t bufferSize = 256, unsigned int leafSize = 16);
+
+    /**
+     * @brief get number of dimensions of the tree
+     */
+    int getDimensions();
+
+    /**
+     * @brief get number of points stored, buffer included
+     */
+    size_t size();
+
+    /**
+     * @brief get the number of points held by each level, 0 for an empty level. Level i holds 0 or
+     * bufferSize * 2^i points.
+     */
+    vector<size_t> levelSizes();
+
+    /**
+     * @brief get the number of bytes used by the buffer and the level trees
+     */
+    size_t memoryBytes();
+
+    /**
+     * @brief adds a point to the write buffer, building the buffer into the levels once it is full
+     *
+     * @param point (PointView) point to insert
+     * @return size_t id of the point, the number of points inserted before it
+     */
+    size_t insert(PointView point);
+
+    /**
+     * @brief adds batchCount points packed one after another, point i starting at coordinates[i * dimensions].
+     * Merges run once per filled buffer, exactly as with batchCount single inserts.
+     *
+     * @param coordinates (const double*) batchCount * dimensions coordinates
+     * @param batchCount (size_t) number of points
+     * @return size_t id of the first point, the others follow in order
+     */
+    size_t insertBatch(const double *coordinates, size_t batchCount);
+
+    /**
+     * @brief determines the stored point nearest to the query over the buffer and every level
+     *
+     * @param query (const vector<double>&) point to find the nearest neighbor of
+     * @return Neighbor nearest point with its distance, id is NO_ID if the tree is empty
+     */
+    Neighbor nearestNeighborSearch(const vector<double> &query);
+
+    /**
+     * @brief finds the count stored points nearest to the query: the count nearest of the buffer and of every
+     * level are merged and the count nearest overall kept
+     *
+     * @param query (const vector<double>&) point to find the neighbors of
+     * @param count (unsigned int) number of neighbors to return, fewer if the tree holds fewer points
+     * @return vector<Neighbor> nearest points with their euclidean distance, sorted by distance
+     */
+    vector<Neighbor> kNearest(const vector<double> &query, unsigned int count);
+
+    /**
+     * @brief find all points inside a k-dimensional box, bounds included, over the buffer and every level
+     *
+     * @param minCorner (const vector<double>&) minimum value of the box on every dimension
+     * @param maxCorner (const vector<double>&) maximum value of the box on every dimension
+     * @return vector<size_t> ids of the points within the box, buffer first then level by level
+     */
+    vector<size_t> rangeSearch(const vector<double> &minCorner, const vector<double> &maxCorner);
+
+private:
+    /**
+     * Level struct is one static tree with the ids of its points: the point with tree id i has id ids[i]
+     */
+    struct Level {
+        unique_ptr<FlatKDTree> tree;
+        vector<size_t> ids;
+    };
+
+    unsigned int k;
+    size_t bufferSize;
+    unsigned int leafSize;
+    size_t pointCount;
+    vector<double> buffer;
+    vector<size_t> bufferIds;
+    vector<Level> levels;
+
+    void checkDimensions(const vector<double> &point);
+    void flushBuffer();
+};
+
+#endif
@@ -0,0 +1,478 @@
+#ifndef FIXEDKDTREE_H__
+#define FIXEDKDTREE_H__ //check for dup declarations
+
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include "./TraversalStack.h"
+
+using namespace std;
+
+/**
+ * FixedKDTree is a KDTree whose number of dimensions K and coordinate type Scalar are template parameters.
+ * Points are std::array<Scalar, K>, so distance loops have a compile-time trip count and unroll fully, and
+ * query traversals carry the axis as a template parameter so the axis cycle is resolved at compile time
+ * instead of a depth % k per node. Scalar can be float or double.
+ * Queries are loops over an explicit TraversalStack: each descent is unrolled K levels at a time so every
+ * level still sees its axis as a constant, and a degenerate tree built from sorted inserts cannot overflow
+ * the call stack.
+ *
+ * It follows the same rules as KDTree (smaller values go left, equal or greater values go right) and stores
+ * nodes in one contiguous vector with index-based children. Nodes are identified by their index, which is
+ * stable: the n-th inserted point is node n, and after build the i-th input point is node i.
+ * Use KDTree when the number of dimensions is only known at runtime.
+ */
+template <unsigned int K, typename Scalar = double>
+class FixedKDTree {
+public:
+    typedef array<Scalar, K> Point;
+
+    /**
+     * index returned when there is no such node
+     */
+    static const int NONE = -1;
+
+    /**
+     * Neighbor struct pairs the index of a node found by a nearest neighbor query with its distance to the query
+     */
+    struct Neighbor {
+        int node;
+        Scalar distance;
+    };
+
+    FixedKDTree();
+    ~FixedKDTree();
+
+    /**
+     * @brief get number of dimensions of the tree
+     */
+    int getDimensions();
+
+    /**
+     * @brief get number of points stored in the tree
+     */
+    size_t size();
+
+    /**
+     * @brief get the point stored at a node index
+     */
+    const Point &getPoint(int node);
+
+    /**
+     * @brief inserts a point into the tree. Traverses the tree comparing the dimension of each level and
+     * links the new node at the first empty branch.
+     * 
+     * @param point (const Point&) point to insert
+     * @return int index of the new node
+     */
+    int insertNode(const Point &point);
+
+    /**
+     * @brief builds a balanced tree from a set of points with median splits, replacing the current contents.
+     * Node i holds points[i].
+     * 
+     * @param points (const vector<Point>&) points to build the tree from
+     */
+    void build(const vector<Point> &points);
+
+    /**
+     * @brief get node from tree by traversing the tree and comparing the dimension of each level
+     * 
+     * @param point (const Point&) point to find in tree
+     * @return int index of the found node or NONE if not found
+     */
+    int getNode(const Point &point);
+
+    /**
+     * @brief determines the node nearest to the target, a stored point equal to the target is a valid answer
+     * 
+     * @param target (const Point&) point to find the nearest neighbor of
+     * @return int index of the nearest node or NONE if the tree is empty
+     */
+    int nearestNeighborSearch(const Point &target);
+
+    /**
+     * @brief determines the count nodes nearest to a query point, sorted from nearest to farthest, using a
+     * max-heap bounded to count entries like KDTree::kNearest
+     * 
+     * @param query (const Point&) point to find the nearest neighbors of
+     * @param count (unsigned int) number of neighbors to return
+     * @param includeExactMatches (bool) whether points equal to the query are returned (distance 0)
+     * @return vector<Neighbor> nearest nodes with their euclidean distance, sorted by distance
+     */
+    vector<Neighbor> kNearest(const Point &query, unsigned int count, bool includeExactMatches = true);
+
+    /**
+     * @brief find all nodes inside a box given by its minimum and maximum corner, bounds included, pruning
+     * subtrees with the splitting plane of each level
+     * 
+     * @param minCorner (const Point&) minimum value of the box on every dimension
+     * @param maxCorner (const Point&) maximum value of the box on every dimension
+     * @return vector<int> indices of the nodes within the box
+     */
+    vector<int> rangeSearch(const Point &minCorner, const Point &maxCorner);
+
+private:
+    struct FixedNode {
+        Point point;
+        int left;
+        int right;
+    };
+
+    vector<FixedNode> nodes;
+    int root;
+
+    /**
+     * Frame struct is a subtree left for later by a query: its root, the axis of its root and the squared
+     * distance from the query to the splitting plane in front of it (0 when it cannot be pruned)
+     */
+    struct Frame {
+        int node;
+        unsigned int axis;
+        Scalar bound;
+    };
+
+    /**
+     * Descent walks Steps levels down a branch. Search::step<Axis>(node) handles one node, pushes any other
+     * child it still has to visit and returns the child to continue with, so every level is compiled with its
+     * axis as a constant.
+     */
+    template <unsigned int Axis, unsigned int Steps, typename Unused = void>
+    struct Descent {
+        template <typename Search>
+        static int run(int node, Search &search) {
+            if (node == NONE) {
+                return NONE;
+            }
+            return Descent<(Axis + 1) % K, Steps - 1>::run(search.template step<Axis>(node), search);
+        }
+    };
+
+    template <unsigned int Axis, typename Unused>
+    struct Descent<Axis, 0, Unused> {
+        template <typename Search>
+        static int run(int node, Search &) {
+            return node;
+        }
+    };
+
+    struct NNSearch {
+        FixedKDTree *tree;
+        const Point *target;
+        TraversalStack<Frame> *stack;
+        int best;
+        Scalar bestDist;
+        template <unsigned int Axis>
+        int step(int node);
+    };
+
+    struct KNNSearch {
+        FixedKDTree *tree;
+        const Point *query;
+        TraversalStack<Frame> *stack;
+        unsigned int count;
+        bool includeExactMatches;
+        vector<Neighbor> *heap;
+        template <unsigned int Axis>
+        int step(int node);
+    };
+
+    struct RangeSearch {
+        FixedKDTree *tree;
+        const Point *minCorner;
+        const Point *maxCorner;
+        TraversalStack<Frame> *stack;
+        vector<int> *nodesInRange;
+        template <unsigned int Axis>
+        int step(int node);
+    };
+
+    static Scalar squaredDistance(const Point &a, const Point &b);
+    static bool neighborIsCloser(const Neighbor &a, const Neighbor &b);
+    int recurseBuild(vector<int> &order, size_t first, size_t last, unsigned int depth);
+    template <typename Search, unsigned int Axis>
+    static void descend(unsigned int axis, int node, Search &search, integral_constant<unsigned int, Axis>);
+    template <typename Search>
+    static void descend(unsigned int axis, int node, Search &search, integral_constant<unsigned int, K>);
+};
+
+template <unsigned int K, typename Scalar>
+const int FixedKDTree<K, Scalar>::NONE;
+
+template <unsigned int K, typename Scalar>
+FixedKDTree<K, Scalar>::FixedKDTree() {
+    static_assert(K > 0, "A FixedKDTree needs at least one dimension.");
+    static_assert(is_floating_point<Scalar>::value, "A FixedKDTree needs float, double or long double coordinates.");
+    root = NONE;
+}
+
+template <unsigned int K, typename Scalar>
+FixedKDTree<K, Scalar>::~FixedKDTree() {}
+
+template <unsigned int K, typename Scalar>
+int FixedKDTree<K, Scalar>::getDimensions() {
+    return K;
+}
+
+template <unsigned int K, typename Scalar>
+size_t FixedKDTree<K, Scalar>::size() {
+    return nodes.size();
+}
+
+template <unsigned int K, typename Scalar>
+const typename FixedKDTree<K, Scalar>::Point &FixedKDTree<K, Scalar>::getPoint(int node) {
+    return nodes[node].point;
+}
+
+template <unsigned int K, typename Scalar>
+Scalar FixedKDTree<K, Scalar>::squaredDistance(const Point &a, const Point &b) {
+    Scalar distance = 0;
+    for (unsigned int i = 0; i < K; i++) {
+        Scalar diff = a[i] - b[i];
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+template <unsigned int K, typename Scalar>
+bool FixedKDTree<K, Scalar>::neighborIsCloser(const Neighbor &a, const Neighbor &b) {
+    return a.distance < b.distance;
+}
+
+template <unsigned int K, typename Scalar>
+int FixedKDTree<K, Scalar>::insertNode(const Point &point) {
+    FixedNode node;
+    node.point = point;
+    node.left = NONE;
+    node.right = NONE;
+    int index = (int)nodes.size();
+    nodes.push_back(node);
+
+    if (root == NONE) {
+        root = index;
+        return index;
+    }
+
+    int current = root;
+    unsigned int d = 0;
+    while (true) {
+        int &branch = point[d] < nodes[current].point[d] ? nodes[current].left : nodes[current].right;
+        if (branch == NONE) {
+            branch = index;
+            return index;
+        }
+        current = branch;
+        d = d + 1 == K ? 0 : d + 1;
+    }
+}
+
+template <unsigned int K, typename Scalar>
+void FixedKDTree<K, Scalar>::build(const vector<Point> &points) {
+    nodes.clear();
+    nodes.reserve(points.size());
+    vector<int> order(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        FixedNode node;
+        node.point = points[i];
+        node.left = NONE;
+        node.right = NONE;
+        nodes.push_back(node);
+        order[i] = (int)i;
+    }
+    root = recurseBuild(order, 0, order.size(), 0);
+}
+
+template <unsigned int K, typename Scalar>
+int FixedKDTree<K, Scalar>::recurseBuild(vector<int> &order, size_t first, size_t last, unsigned int depth) {
+    if (first >= last) {
+        return NONE;
+    }
+    unsigned int d = depth % K;
+    size_t mid = first + (last - first) / 2;
+    vector<FixedNode> &all = nodes;
+
+    nth_element(order.begin() + first, order.begin() + mid, order.begin() + last, [&all, d](int a, int b) {
+        return all[a].point[d] < all[b].point[d];
+    });
+
+    // points equal to the median must go right, so pull the smallest median-valued point up as the root
+    Scalar median = nodes[order[mid]].point[d];
+    typename vector<int>::iterator split = partition(order.begin() + first, order.begin() + mid, [&all, d, median](int i) {
+        return all[i].point[d] < median;
+    });
+    size_t splitIndex = split - order.begin();
+    swap(order[splitIndex], order[mid]);
+
+    int node = order[splitIndex];
+    int left = recurseBuild(order, first, splitIndex, depth + 1);
+    int right = recurseBuild(order, splitIndex + 1, last, depth + 1);
+    nodes[node].left = left;
+    nodes[node].right = right;
+    return node;
+}
+
+template <unsigned int K, typename Scalar>
+int FixedKDTree<K, Scalar>::getNode(const Point &point) {
+    int node = root;
+    unsigned int d = 0;
+    while (node != NONE) {
+        if (nodes[node].point == point) {
+            return node;
+        }
+        node = point[d] < nodes[node].point[d] ? nodes[node].left : nodes[node].right;
+        d = d + 1 == K ? 0 : d + 1;
+    }
+    return NONE;
+}
+
+template <unsigned int K, typename Scalar>
+template <typename Search, unsigned int Axis>
+void FixedKDTree<K, Scalar>::descend(unsigned int axis, int node, Search &search, integral_constant<unsigned int, Axis>) {
+    // the axis is only dispatched once per popped frame, the descent below it is unrolled K levels at a time
+    if (axis != Axis) {
+        descend(axis, node, search, integral_constant<unsigned int, Axis + 1>());
+        return;
+    }
+    while (node != NONE) {
+        node = Descent<Axis, K>::run(node, search);
+    }
+}
+
+template <unsigned int K, typename Scalar>
+template <typename Search>
+void FixedKDTree<K, Scalar>::descend(unsigned int, int, Search &, integral_constant<unsigned int, K>) {}
+
+template <unsigned int K, typename Scalar>
+template <unsigned int Axis>
+int FixedKDTree<K, Scalar>::NNSearch::step(int node) {
+    const FixedNode &current = tree->nodes[node];
+    Scalar currentDist = squaredDistance(current.point, *target);
+    if (best == NONE || currentDist < bestDist) {
+        best = node;
+        bestDist = currentDist;
+    }
+
+    int nextBranch = (*target)[Axis] < current.point[Axis] ? current.left : current.right;
+    int otherBranch = (*target)[Axis] < current.point[Axis] ? current.right : current.left;
+    if (otherBranch != NONE) {
+        Scalar currentDistToPlane = (*target)[Axis] - current.point[Axis];
+        Frame frame = {otherBranch, (Axis + 1) % K, currentDistToPlane * currentDistToPlane};
+        stack->push(frame);
+    }
+    return nextBranch;
+}
+
+template <unsigned int K, typename Scalar>
+int FixedKDTree<K, Scalar>::nearestNeighborSearch(const Point &target) {
+    TraversalStack<Frame> stack;
+    NNSearch search = {this, &target, &stack, NONE, numeric_limits<Scalar>::infinity()};
+    Frame start = {root, 0, 0};
+    stack.push(start);
+    while (!stack.empty()) {
+        Frame frame = stack.pop();
+        // the far side of a plane is only searched once the near side has been and still might hold a closer point
+        if (frame.bound < search.bestDist) {
+            descend(frame.axis, frame.node, search, integral_constant<unsigned int, 0>());
+        }
+    }
+    return search.best;
+}
+
+template <unsigned int K, typename Scalar>
+template <unsigned int Axis>
+int FixedKDTree<K, Scalar>::KNNSearch::step(int node) {
+    // heap holds squared distances while searching, its front is the farthest of the current candidates
+    const FixedNode &current = tree->nodes[node];
+    Scalar currentDist = squaredDistance(current.point, *query);
+    if (includeExactMatches || currentDist > 0) {
+        if (heap->size() < count) {
+            Neighbor neighbor = {node, currentDist};
+            heap->push_back(neighbor);
+            push_heap(heap->begin(), heap->end(), neighborIsCloser);
+        } else if (currentDist < heap->front().distance) {
+            pop_heap(heap->begin(), heap->end(), neighborIsCloser);
+            heap->back().node = node;
+            heap->back().distance = currentDist;
+            push_heap(heap->begin(), heap->end(), neighborIsCloser);
+        }
+    }
+
+    int nextBranch = (*query)[Axis] < current.point[Axis] ? current.left : current.right;
+    int otherBranch = (*query)[Axis] < current.point[Axis] ? current.right : current.left;
+    if (otherBranch != NONE) {
+        Scalar currentDistToPlane = (*query)[Axis] - current.point[Axis];
+        Frame frame = {otherBranch, (Axis + 1) % K, currentDistToPlane * currentDistToPlane};
+        stack->push(frame);
+    }
+    return nextBranch;
+}
+
+template <unsigned int K, typename Scalar>
+vector<typename FixedKDTree<K, Scalar>::Neighbor> FixedKDTree<K, Scalar>::kNearest(const Point &query, unsigned int count, bool includeExactMatches) {
+    vector<Neighbor> heap;
+    if (count == 0) {
+        return heap;
+    }
+    heap.reserve(count);
+
+    TraversalStack<Frame> stack;
+    KNNSearch search = {this, &query, &stack, count, includeExactMatches, &heap};
+    Frame start = {root, 0, 0};
+    stack.push(start);
+    while (!stack.empty()) {
+        Frame frame = stack.pop();
+        if (heap.size() < count || frame.bound < heap.front().distance) {
+            descend(frame.axis, frame.node, search, integral_constant<unsigned int, 0>());
+        }
+    }
+
+    sort_heap(heap.begin(), heap.end(), neighborIsCloser);
+    for (size_t i = 0; i < heap.size(); i++) {
+        heap[i].distance = sqrt(heap[i].distance);
+    }
+    return heap;
+}
+
+template <unsigned int K, typename Scalar>
+template <unsigned int Axis>
+int FixedKDTree<K, Scalar>::RangeSearch::step(int node) {
+    const FixedNode &current = tree->nodes[node];
+    bool inRange = true;
+    for (unsigned int i = 0; i < K; i++) {
+        inRange &= (*minCorner)[i] <= current.point[i] && current.point[i] <= (*maxCorner)[i];
+    }
+    if (inRange) {
+        nodesInRange->push_back(node);
+    }
+
+    int left = (*minCorner)[Axis] < current.point[Axis] ? current.left : NONE;
+    int right = current.point[Axis] <= (*maxCorner)[Axis] ? current.right : NONE;
+    if (left == NONE) {
+        return right;
+    }
+    if (right != NONE) {
+        Frame frame = {right, (Axis + 1) % K, 0};
+        stack->push(frame);
+    }
+    return left;
+}
+
+template <unsigned int K, typename Scalar>
+vector<int> FixedKDTree<K, Scalar>::rangeSearch(const Point &minCorner, const Point &maxCorner) {
+    vector<int> nodesInRange;
+    TraversalStack<Frame> stack;
+    RangeSearch search = {this, &minCorner, &maxCorner, &stack, &nodesInRange};
+    Frame start = {root, 0, 0};
+    stack.push(start);
+    while (!stack.empty()) {
+        Frame frame = stack.pop();
+        descend(frame.axis, frame.node, search, integral_constant<unsigned int, 0>());
+    }
+    return nodesInRange;
+}
+
+#endif
@@ -0,0 +1,446 @@
+#include "FlatKDTree.h"
+#include "ParallelFor.h"
+#include <cmath>
+#include <cstdint>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const int FlatKDTree::NONE;
+const unsigned int FlatKDTree::MAX_LEAF_SIZE;
+
+/**
+ * FileHeader struct starts every file written by FlatKDTree::save. It is followed by nodeCount FlatNodes,
+ * pointCount * dimensions doubles and pointCount ints; the header and every array size keep the arrays
+ * 8-byte aligned in the file, so the mapped arrays can be read in place.
+ */
+struct FileHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t dimensions;
+    uint32_t leafSize;
+    uint32_t nodeBytes;
+    uint32_t reserved;
+    uint64_t nodeCount;
+    uint64_t pointCount;
+};
+
+static const char FILE_MAGIC[8] = {'F', 'K', 'D', 'T', 'R', 'E', 'E', '\0'};
+static const uint32_t FILE_BYTE_ORDER = 0x01020304;
+static const uint32_t FILE_VERSION = 1;
+
+/**
+ * @brief multiplies then adds unsigned sizes, returning false instead of wrapping around on overflow
+ */
+static bool checkedMultiplyAdd(uint64_t a, uint64_t b, uint64_t c, uint64_t &result) {
+    if (b != 0 && a > (UINT64_MAX - c) / b) {
+        return false;
+    }
+    result = a * b + c;
+    return true;
+}
+
+/**
+ * @brief checks that the arrays of a mapped file describe a tree queries can walk safely: children are later
+ * nodes in preorder, each referenced once, so every walk ends; leaves stay within the point slots; every id is
+ * a point index. Coordinates are not read, they cannot send a query out of bounds.
+ *
+ * @return string description of the first problem found, empty if there is none
+ */
+static string validateTree(const FlatKDTree::FlatNode *nodes, uint64_t nodeCount, const int *ids, uint64_t pointCount, unsigned int leafSize) {
+    vector<bool> referenced(nodeCount, false);
+    for (uint64_t i = 0; i < nodeCount; i++) {
+        const FlatKDTree::FlatNode &node = nodes[i];
+        if (node.count == 0) {
+            int children[2] = {node.left, node.right};
+            for (int child : children) {
+                if (child == FlatKDTree::NONE) {
+                    continue;
+                }
+                if (child < 0 || (uint64_t)child <= i || (uint64_t)child >= nodeCount || referenced[child]) {
+                    return "node " + to_string(i) + " has an invalid child index " + to_string(child);
+                }
+                referenced[child] = true;
+            }
+        } else if (node.count > leafSize || (uint64_t)node.first + node.count > pointCount
+                || node.left != FlatKDTree::NONE || node.right != FlatKDTree::NONE) {
+            return "leaf " + to_string(i) + " is out of bounds";
+        }
+    }
+    for (uint64_t i = 0; i < pointCount; i++) {
+        if (ids[i] < 0 || (uint64_t)ids[i] >= pointCount) {
+            return "point slot " + to_string(i) + " has an invalid id " + to_string(ids[i]);
+        }
+    }
+    return "";
+}
+
+FlatKDTree::FlatKDTree(unsigned int k, const vector<vector<double>> &points, unsigned int leafSize) {
+    if (k == 0) {
+        throw invalid_argument("Incorrect number of dimensions provided. Please enter a dimension greater than 0.");
+    }
+    if (leafSize == 0 || leafSize > MAX_LEAF_SIZE) {
+        throw invalid_argument("Incorrect leaf size provided. Please enter a leaf size between 1 and 256.");
+    }
+    this->k = k;
+    this->leafSize = leafSize;
+    mapping = nullptr;
+    mappingBytes = 0;
+
+    vector<double> packed;
+    packed.reserve(points.size() * k);
+    for (const vector<double> &point : points) {
+        if (point.size() != k) {
+            throw invalid_argument("Incorrect number of dimensions in point. Every point must have the dimensions of the tree.");
+        }
+        packed.insert(packed.end(), point.begin(), point.end());
+    }
+    buildFromPacked(packed.data(), points.size());
+}
+
+FlatKDTree::FlatKDTree(unsigned int k, const double *coordinates, size_t count, unsigned int leafSize) {
+    if (k == 0) {
+        throw invalid_argument("Incorrect number of dimensions provided. Please enter a dimension greater than 0.");
+    }
+    if (leafSize == 0 || leafSize > MAX_LEAF_SIZE) {
+        throw invalid_argument("Incorrect leaf size provided. Please enter a leaf size between 1 and 256.");
+    }
+    this->k = k;
+    this->leafSize = leafSize;
+    mapping = nullptr;
+    mappingBytes = 0;
+    buildFromPacked(coordinates, count);
+}
+
+FlatKDTree::FlatKDTree(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open FlatKDTree file " + path + ".");
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(FileHeader)) {
+        close(fd);
+        throw runtime_error("Not a FlatKDTree file: " + path + " is too small.");
+    }
+    mappingBytes = (size_t)status.st_size;
+    mapping = mmap(nullptr, mappingBytes, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps the file contents reachable on its own
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        throw runtime_error("Cannot memory-map FlatKDTree file " + path + ".");
+    }
+
+    const FileHeader *header = (const FileHeader *)mapping;
+    string error;
+    if (memcmp(header->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+        error = "Not a FlatKDTree file: " + path + ".";
+    } else if (header->byteOrder != FILE_BYTE_ORDER) {
+        error = "FlatKDTree file " + path + " was written on a machine with a different byte order.";
+    } else if (header->version != FILE_VERSION) {
+        error = "FlatKDTree file " + path + " uses format version " + to_string(header->version) + ", expected " + to_string(FILE_VERSION) + ".";
+    } else if (header->nodeBytes != sizeof(FlatNode)) {
+        error = "FlatKDTree file " + path + " was written with a different node layout.";
+    } else if (header->dimensions == 0 || header->leafSize == 0 || header->leafSize > MAX_LEAF_SIZE
+            || header->nodeCount > (uint64_t)INT_MAX || header->pointCount > (uint64_t)INT_MAX) {
+        error = "FlatKDTree file " + path + " is corrupt or truncated.";
+    } else {
+        // sizes come from the file, so every step is checked for overflow before comparing with its length
+        uint64_t expectedBytes = 0;
+        bool sized = checkedMultiplyAdd(header->nodeCount, sizeof(FlatNode), sizeof(FileHeader), expectedBytes)
+            && checkedMultiplyAdd(header->pointCount, sizeof(int), expectedBytes, expectedBytes)
+            && checkedMultiplyAdd(header->pointCount * header->dimensions, sizeof(double), expectedBytes, expectedBytes);
+        if (!sized || mappingBytes != expectedBytes) {
+            error = "FlatKDTree file " + path + " is corrupt or truncated.";
+        } else {
+            const char *arrays = (const char *)mapping + sizeof(FileHeader);
+            const FlatNode *fileNodes = (const FlatNode *)arrays;
+            const int *fileIds = (const int *)(arrays + header->nodeCount * sizeof(FlatNode) + header->pointCount * header->dimensions * sizeof(double));
+            string problem = validateTree(fileNodes, header->nodeCount, fileIds, header->pointCount, header->leafSize);
+            if (!problem.empty()) {
+                error = "FlatKDTree file " + path + " is corrupt: " + problem + ".";
+            }
+        }
+    }
+    if (!error.empty()) {
+        munmap(mapping, mappingBytes);
+        mapping = nullptr;
+        throw runtime_error(error);
+    }
+
+    k = header->dimensions;
+    leafSize = header->leafSize;
+    nodeCount = header->nodeCount;
+    pointCount = header->pointCount;
+    const char *arrays = (const char *)mapping + sizeof(FileHeader);
+    nodeData = (const FlatNode *)arrays;
+    coordinateData = (const double *)(arrays + nodeCount * sizeof(FlatNode));
+    idData = (const int *)(arrays + nodeCount * sizeof(FlatNode) + pointCount * k * sizeof(double));
+}
+
+FlatKDTree::~FlatKDTree() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingBytes);
+    }
+}
+
+void FlatKDTree::bindStorage() {
+    nodeData = nodes.data();
+    coordinateData = coordinates.data();
+    idData = ids.data();
+    nodeCount = nodes.size();
+    pointCount = ids.size();
+}
+
+void FlatKDTree::save(const string &path) {
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.byteOrder = FILE_BYTE_ORDER;
+    header.version = FILE_VERSION;
+    header.dimensions = k;
+    header.leafSize = leafSize;
+    header.nodeBytes = sizeof(FlatNode);
+    header.nodeCount = nodeCount;
+    header.pointCount = pointCount;
+
+    ofstream file(path.c_str(), ios::binary | ios::trunc);
+    file.write((const char *)&header, sizeof(header));
+    file.write((const char *)nodeData, nodeCount * sizeof(FlatNode));
+    file.write((const char *)coordinateData, pointCount * k * sizeof(double));
+    file.write((const char *)idData, pointCount * sizeof(int));
+    file.close();
+    if (!file) {
+        throw runtime_error("Cannot write FlatKDTree file " + path + ".");
+    }
+}
+
+void FlatKDTree::buildFromPacked(const double *points, size_t count) {
+    if (count > (size_t)numeric_limits<int>::max()) {
+        throw invalid_argument("Too many points for a FlatKDTree.");
+    }
+
+    coordinates.reserve(count * k);
+    unsigned int dims = k;
+    vector<double> &stored = coordinates;
+    buildBucketTree(k, leafSize, points, count, nodes, ids, [points, dims, &stored](int point, unsigned int d) {
+        stored.push_back(points[(size_t)point * dims + d]);
+    });
+    bindStorage();
+}
+
+BucketTree<DoubleLeaves> FlatKDTree::buckets() {
+    DoubleLeaves leaves = {coordinateData};
+    return BucketTree<DoubleLeaves>(k, nodeData, nodeCount, leaves);
+}
+
+int FlatKDTree::getNode(const vector<double> &point) {
+    if (point.size() != k) {
+        return NONE;
+    }
+    int slot = buckets().findSlot(point.data());
+    return slot == NONE ? NONE : idData[slot];
+}
+
+int FlatKDTree::nearestNeighborSearch(const vector<double> &target) {
+    if (target.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in point. Every point must have the dimensions of the tree.");
+    }
+    BucketTree<DoubleLeaves> tree = buckets();
+    NearestSlotScan nearest = {NONE, numeric_limits<double>::infinity()};
+    double radius = nearest.bestDist;
+
+    tree.searchNearest(tree.root(), target.data(), nullptr, radius, nearest, 0);
+    return nearest.best == NONE ? NONE : idData[nearest.best];
+}
+
+vector<int> FlatKDTree::rangeSearch(const vector<double> &minCorner, const vector<double> &maxCorner) {
+    if (minCorner.size() != k || maxCorner.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in range. Both corners must have the dimensions of the tree.");
+    }
+    vector<int> idsInRange;
+    IdsInBoxScan collect = {idData, idsInRange};
+    BucketTree<DoubleLeaves> tree = buckets();
+    tree.searchBox(tree.root(), minCorner.data(), maxCorner.data(), collect, 0);
+    return idsInRange;
+}
+
+static bool flatNeighborIsCloser(const FlatKDTree::Neighbor &a, const FlatKDTree::Neighbor &b) {
+    return a.distance < b.distance;
+}
+
+/**
+ * KNearestScan struct keeps the count nearest point slots of the buckets a search visits in a max-heap of
+ * point slots and squared distances. Until the heap is full every bucket must be visited, so the radius
+ * stays infinite.
+ */
+struct KNearestScan {
+    vector<FlatKDTree::Neighbor> &heap;
+    unsigned int count;
+
+    double radius() const {
+        return heap.size() < count ? numeric_limits<double>::infinity() : heap.front().distance;
+    }
+
+    double operator()(const BucketNode &leaf, const double *distances) {
+        for (unsigned int i = 0; i < leaf.count; i++) {
+            push((int)(leaf.first + i), distances[i]);
+        }
+        return radius();
+    }
+
+    void push(int slot, double distance) {
+        if (heap.size() < count) {
+            FlatKDTree::Neighbor neighbor = {slot, distance};
+            heap.push_back(neighbor);
+            push_heap(heap.begin(), heap.end(), flatNeighborIsCloser);
+        } else if (distance < heap.front().distance) {
+            pop_heap(heap.begin(), heap.end(), flatNeighborIsCloser);
+            heap.back().id = slot;
+            heap.back().distance = distance;
+            push_heap(heap.begin(), heap.end(), flatNeighborIsCloser);
+        }
+    }
+};
+
+vector<FlatKDTree::Neighbor> FlatKDTree::kNearest(const vector<double> &query, unsigned int count) {
+    if (query.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in point. Every point must have the dimensions of the tree.");
+    }
+    vector<Neighbor> neighbors;
+    if (count == 0) {
+        return neighbors;
+    }
+    neighbors.reserve(min((size_t)count, pointCount));
+    BucketTree<DoubleLeaves> tree = buckets();
+    KNearestScan nearest = {neighbors, count};
+    double radius = nearest.radius();
+    tree.searchNearest(tree.root(), query.data(), nullptr, radius, nearest, 0);
+
+    sort_heap(neighbors.begin(), neighbors.end(), flatNeighborIsCloser);
+    for (Neighbor &neighbor : neighbors) {
+        neighbor.id = idData[neighbor.id];
+        neighbor.distance = sqrt(neighbor.distance);
+    }
+    return neighbors;
+}
+
+vector<int> FlatKDTree::allNearestNeighbors(unsigned int threadCount) {
+    vector<Neighbor> neighbors = allKNearest(1, threadCount);
+    vector<int> nearest(neighbors.size());
+    for (size_t i = 0; i < neighbors.size(); i++) {
+        nearest[i] = neighbors[i].id;
+    }
+    return nearest;
+}
+
+vector<FlatKDTree::Neighbor> FlatKDTree::allKNearest(unsigned int count, unsigned int threadCount) {
+    Neighbor padding = {NONE, numeric_limits<double>::infinity()};
+    vector<Neighbor> results(pointCount * count, padding);
+    if (count == 0 || pointCount == 0) {
+        return results;
+    }
+
+    // nodes are in preorder, so a node's parent always comes before it
+    vector<int> parents(nodeCount, NONE);
+    vector<unsigned int> depths(nodeCount, 0);
+    vector<int> leaves;
+    for (size_t node = 0; node < nodeCount; node++) {
+        const FlatNode &current = nodeData[node];
+        if (current.count > 0) {
+            leaves.push_back((int)node);
+            continue;
+        }
+        int children[2] = {current.left, current.right};
+        for (int child : children) {
+            if (child != NONE) {
+                parents[child] = (int)node;
+                depths[child] = depths[node] + 1;
+            }
+        }
+    }
+
+    parallelFor(leaves.size(), threadCount, [this, count, &parents, &depths, &leaves, &results](size_t l) {
+        BucketTree<DoubleLeaves> tree = buckets();
+        const FlatNode &leaf = nodeData[leaves[l]];
+        const double *block = &coordinateData[(size_t)leaf.first * k];
+        vector<double> query(k);
+        vector<Neighbor> heap;
+        heap.reserve(count);
+        KNearestScan nearest = {heap, count};
+        double distances[MAX_LEAF_SIZE];
+
+        for (unsigned int i = 0; i < leaf.count; i++) {
+            for (unsigned int d = 0; d < k; d++) {
+                query[d] = block[(size_t)d * leaf.count + i];
+            }
+            heap.clear();
+            squaredDistancesSoA(block, leaf.count, k, query.data(), distances);
+            for (unsigned int j = 0; j < leaf.count; j++) {
+                if (j != i) {
+                    nearest.push((int)(leaf.first + j), distances[j]);
+                }
+            }
+
+            // every other point lies in a sibling subtree of the path back to the root
+            for (int node = leaves[l]; parents[node] != NONE; node = parents[node]) {
+                const FlatNode &parent = nodeData[parents[node]];
+                int sibling = parent.left == node ? parent.right : parent.left;
+                double distToPlane = query[depths[parents[node]] % k] - parent.split;
+                double radius = nearest.radius();
+                if (sibling != NONE && distToPlane * distToPlane < radius) {
+                    tree.searchNearest(sibling, query.data(), nullptr, radius, nearest, depths[parents[node]] + 1);
+                }
+            }
+
+            sort_heap(heap.begin(), heap.end(), flatNeighborIsCloser);
+            Neighbor *out = &results[(size_t)idData[leaf.first + i] * count];
+            for (size_t j = 0; j < heap.size(); j++) {
+                out[j].id = idData[heap[j].id];
+                out[j].distance = sqrt(heap[j].distance);
+            }
+        }
+    }, 1);
+    return results;
+}
+
+void FlatKDTree::copyPoints(double *points) {
+    for (size_t node = 0; node < nodeCount; node++) {
+        const FlatNode &leaf = nodeData[node];
+        const double *block = &coordinateData[(size_t)leaf.first * k];
+        for (unsigned int i = 0; i < leaf.count; i++) {
+            double *point = &points[(size_t)idData[leaf.first + i] * k];
+            for (unsigned int d = 0; d < k; d++) {
+                point[d] = block[(size_t)d * leaf.count + i];
+            }
+        }
+    }
+}
+
+int FlatKDTree::getDimensions() {
+    return k;
+}
+
+unsigned int FlatKDTree::getLeafSize() {
+    return leafSize;
+}
+
+size_t FlatKDTree::size() {
+    return pointCount;
+}
+
+size_t FlatKDTree::memoryBytes() {
+    if (mapping != nullptr) {
+        return mappingBytes;
+    }
+    return nodes.capacity() * sizeof(FlatNode) + coordinates.capacity() * sizeof(double) + ids.capacity() * sizeof(int);
+}
+
+bool FlatKDTree::isMapped() {
+    return mapping != nullptr;
+}
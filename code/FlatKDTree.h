@@ -0,0 +1,216 @@
+#ifndef FLATKDTREE_H__
+#define FLATKDTREE_H__ //check for dup declarations
+
+#include "./BucketTree.h"
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+/**
+ * FlatKDTree is a read-only KDTree whose nodes live in one contiguous array and whose coordinates live in
+ * one packed buffer. It follows the same rules as KDTree (the dimension alternates with depth, smaller values
+ * go left, equal or greater values go right), but points are kept in leaf buckets of up to leafSize points.
+ * Internal nodes only hold a split value and the array indices of their children; a leaf holds a range of
+ * point slots whose coordinates are stored structure-of-arrays, so the bottom of every query is a streaming
+ * SIMD loop (see DistanceKernels.h) instead of one branch and pointer chase per point. The build and the
+ * traversals are the BucketTree ones CompactKDTree shares, reading the doubles in place.
+ *
+ * Points are identified by their id: the index of the point in the input used to build the tree.
+ *
+ * A built tree can be written to disk with save() and opened again with the path constructor, which
+ * memory-maps the file and queries the mapped arrays in place: nothing is deserialized or allocated per node,
+ * and processes opening the same file share one read-only copy through the page cache.
+ */
+class FlatKDTree {
+public:
+    /**
+     * id/index returned when there is no such point or node
+     */
+    static const int NONE = -1;
+
+    /**
+     * largest number of points a leaf bucket can hold
+     */
+    static const unsigned int MAX_LEAF_SIZE = BucketNode::MAX_LEAF_SIZE;
+
+    /**
+     * FlatNode is either an internal node or a leaf (see BucketNode). A leaf's coordinates start at
+     * coordinates[first * k] stored structure-of-arrays, and the id of slot s is ids[s].
+     */
+    typedef BucketNode FlatNode;
+
+    /**
+     * Neighbor struct is one result of a k-nearest neighbor search: the id of a point and its distance to the query
+     */
+    struct Neighbor {
+        int id;
+        double distance;
+    };
+
+    /**
+     * @brief Builds a balanced FlatKDTree from a set of points using median splits.
+     * 
+     * @param dimensions (unsigned int) The number of dimensions of each point. Must be greater than zero.
+     * @param points (const vector<vector<double>>&) points to store, each must have `dimensions` coordinates
+     * @param leafSize (unsigned int) maximum number of points per leaf bucket, between 1 and MAX_LEAF_SIZE
+     */
+    FlatKDTree(unsigned int dimensions, const vector<vector<double>> &points, unsigned int leafSize = 16);
+
+    /**
+     * @brief Builds a balanced FlatKDTree from points packed one after another in a single buffer.
+     * 
+     * @param dimensions (unsigned int) The number of dimensions of each point. Must be greater than zero.
+     * @param coordinates (const double*) count * dimensions coordinates, point i starts at coordinates[i * dimensions]
+     * @param count (size_t) number of points in the buffer
+     * @param leafSize (unsigned int) maximum number of points per leaf bucket, between 1 and MAX_LEAF_SIZE
+     */
+    FlatKDTree(unsigned int dimensions, const double *coordinates, size_t count, unsigned int leafSize = 16);
+
+    /**
+     * @brief Opens a tree written by save() by memory-mapping the file read-only. Queries read the nodes,
+     * coordinates and ids straight from the mapping, which stays open until the tree is destroyed. Opening
+     * reads every node and id once to check the file describes a valid tree, so a damaged file is refused
+     * instead of sending queries out of bounds; the coordinates are not read.
+     * 
+     * @param path (const string&) file written by save()
+     * @throws runtime_error if the file cannot be opened or mapped, is not a FlatKDTree file, was written by
+     * another format version, with another byte order or node layout, is truncated, or holds a child index,
+     * leaf range or id that is out of bounds
+     */
+    explicit FlatKDTree(const string &path);
+    ~FlatKDTree();
+
+    FlatKDTree(const FlatKDTree &) = delete;
+    FlatKDTree &operator=(const FlatKDTree &) = delete;
+
+    /**
+     * @brief Writes the tree to a file: a versioned header (magic, format version, byte order marker,
+     * dimensions, leaf size, node layout size and array lengths) followed by the node array, the packed
+     * coordinates and the ids, each as they are laid out in memory.
+     * 
+     * @param path (const string&) file to create or overwrite
+     * @throws runtime_error if the file cannot be written
+     */
+    void save(const string &path);
+
+    /**
+     * @brief get whether the tree queries a memory-mapped file
+     */
+    bool isMapped();
+
+    /**
+     * @brief get number of dimensions of the tree
+     */
+    int getDimensions();
+
+    /**
+     * @brief get the maximum number of points per leaf bucket
+     */
+    unsigned int getLeafSize();
+
+    /**
+     * @brief get number of points stored in the tree
+     */
+    size_t size();
+
+    /**
+     * @brief get the number of bytes used by the node, coordinate and id arrays, or the size of the mapped file
+     */
+    size_t memoryBytes();
+
+    /**
+     * @brief get the id of a point stored in the tree by traversing the tree and comparing the dimension
+     * of each level, then scanning the leaf bucket
+     * 
+     * @param point (const vector<double>&) point to find in tree
+     * @return int id of the found point or NONE if not found
+     */
+    int getNode(const vector<double> &point);
+
+    /**
+     * @brief determines the stored point nearest to the target. Same traversal as KDTree::nearestNeighborSearch:
+     * descend towards the target, then on the way back check the other branch only if the splitting plane
+     * is closer than the best distance seen so far. A stored point equal to the target is a valid answer.
+     * 
+     * @param target (const vector<double>&) point to find the nearest neighbor of
+     * @return int id of the nearest point or NONE if the tree is empty
+     */
+    int nearestNeighborSearch(const vector<double> &target);
+
+    /**
+     * @brief find all points inside a k-dimensional box, bounds included. Subtrees whose side of the splitting
+     * plane lies outside the box are skipped.
+     * 
+     * @param minCorner (const vector<double>&) minimum value of the box on every dimension
+     * @param maxCorner (const vector<double>&) maximum value of the box on every dimension
+     * @return vector<int> ids of the points within the box
+     */
+    vector<int> rangeSearch(const vector<double> &minCorner, const vector<double> &maxCorner);
+
+    /**
+     * @brief finds the count stored points nearest to the query, sorted from nearest to farthest. Same traversal
+     * as nearestNeighborSearch, with the best candidates kept in a max-heap bounded to count entries.
+     * 
+     * @param query (const vector<double>&) point to find the neighbors of
+     * @param count (unsigned int) number of neighbors to return, fewer if the tree holds fewer points
+     * @return vector<Neighbor> ids of the nearest points with their euclidean distance, sorted by distance
+     */
+    vector<Neighbor> kNearest(const vector<double> &query, unsigned int count);
+
+    /**
+     * @brief finds the nearest other stored point of every stored point (all-nearest-neighbors self-join). Points
+     * are processed leaf by leaf: each search starts from the point's own bucket, then walks back up its path
+     * and only enters the sibling subtrees whose splitting plane is closer than the best distance found, instead
+     * of descending from the root. A point is only excluded from its own result by id, so a duplicate of it is
+     * a valid neighbor at distance 0.
+     * 
+     * @param threadCount (unsigned int) number of threads sharing the leaves, 0 for one per hardware core
+     * @return vector<int> nearest other point of every point, indexed by id, NONE if the tree holds one point
+     */
+    vector<int> allNearestNeighbors(unsigned int threadCount = 1);
+
+    /**
+     * @brief allNearestNeighbors keeping the count nearest other points of every point
+     * 
+     * @param count (unsigned int) number of neighbors per point
+     * @param threadCount (unsigned int) number of threads sharing the leaves, 0 for one per hardware core
+     * @return vector<Neighbor> size() * count entries, the neighbors of point id at [id * count] onwards sorted by
+     * distance, padded with {NONE, infinity} when the tree holds count points or fewer
+     */
+    vector<Neighbor> allKNearest(unsigned int count, unsigned int threadCount = 1);
+
+    /**
+     * @brief copies every stored point back into a packed buffer, point id at coordinates[id * dimensions], so a
+     * tree can be rebuilt or merged without keeping its input around
+     * 
+     * @param coordinates (double*) size() * dimensions slots
+     */
+    void copyPoints(double *coordinates);
+
+private:
+    unsigned int k;
+    unsigned int leafSize;
+    vector<FlatNode> nodes;
+    vector<double> coordinates;
+    vector<int> ids;
+
+    // queries go through these, which point either into the vectors above or into the mapped file
+    const FlatNode *nodeData;
+    const double *coordinateData;
+    const int *idData;
+    size_t nodeCount;
+    size_t pointCount;
+    void *mapping;
+    size_t mappingBytes;
+
+    void bindStorage();
+
+    void buildFromPacked(const double *points, size_t count);
+    BucketTree<DoubleLeaves> buckets();
+};
+
+#endif
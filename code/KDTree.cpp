@@ -1,113 +1,432 @@
 #include "KDTree.h"
 
-KDTree::KDTree(unsigned int k) {
+#ifdef KDTREE_STATS
+// counters of the last query run on this thread, see KDTree::lastQueryStats
+static thread_local KDTree::QueryStats queryStats;
+#define STATS_RESET() (queryStats = KDTree::QueryStats())
+#define STATS_VISIT(depth) (queryStats.nodesVisited++, queryStats.maxDepth = max(queryStats.maxDepth, (unsigned int)(depth)))
+#define STATS_DISTANCE() (queryStats.distanceEvaluations++)
+#define STATS_BRANCH(depth) (queryStats.branchesVisited += (depth) > 0 ? 1 : 0)
+#define STATS_PRUNE() (queryStats.branchesPruned++)
+#else
+#define STATS_RESET() ((void)0)
+#define STATS_VISIT(depth) ((void)0)
+#define STATS_DISTANCE() ((void)0)
+#define STATS_BRANCH(depth) ((void)0)
+#define STATS_PRUNE() ((void)0)
+#endif
+
+const size_t KDTree::NO_ID;
+
+KDTree::KDTree(unsigned int k) : pool(k) {
     if (k > 0) {
         this->k = k;
     } else {
         throw invalid_argument("Incorrect number of dimensions provided. Please enter a dimension greater than 0.");
     }
     root = nullptr;
+    selfBalancing = false;
+    alpha = 0.7;
+    maxNodeCount = 0;
+    lazyDeletion = false;
+    compactionThreshold = 0.25;
+    deadCount = 0;
+    nextId = 0;
 }
 
 KDTree::~KDTree() {}
 
-Node* KDTree::recurseInsertion(Node* node, vector<double> point, unsigned int depth) {
-    if (node == nullptr) {
-        return new Node(point);
+unsigned int subtreeSize(Node *node) {
+    return node == nullptr ? 0 : node->getSubtreeSize();
+}
+
+/**
+ * Branch struct is a subtree waiting on the explicit stack of a traversal (or the heap of
+ * approximateNearestNeighbor), with its depth and a lower bound of the squared distance from the query to
+ * any of its points
+ */
+struct Branch {
+    Node *node;
+    unsigned int depth;
+    double bound;
+};
+
+Branch makeBranch(Node *node, unsigned int depth, double bound) {
+    Branch branch = {node, depth, bound};
+    return branch;
+}
+
+// subtrees smaller than this are not worth a thread of their own
+static const size_t PARALLEL_BUILD_MIN_NODES = 1 << 14;
+// points sampled to pick the pivot of a selection pass
+static const size_t SELECT_SAMPLE_SIZE = 63;
+
+// bounds of the nodes equal to the pivot after splitAroundPivot
+struct PivotSplit {
+    size_t equalFirst;
+    size_t greaterFirst;
+};
+
+/**
+ * Gathers, keeping their order, the nodes of [first, last) whose coordinate d is below pivot, then those equal to it,
+ * then those above it, and returns the bounds of the middle group. The range is cut into one block per thread:
+ * each thread sorts the nodes of its block into the three groups and counts them, then copies its block into
+ * scratch at the offsets those counts give, so the result is the same for any thread count.
+ */
+PivotSplit splitAroundPivot(vector<Node *> &nodes, vector<Node *> &scratch, vector<unsigned char> &groups, size_t first, size_t last, unsigned int d, double pivot, unsigned int threads) {
+    size_t blockSize = (last - first + threads - 1) / threads;
+    // counts[3 * block + group]
+    vector<size_t> counts(3 * threads, 0);
+    parallelFor(threads, threads, [&](size_t block) {
+        size_t blockFirst = min(last, first + block * blockSize);
+        size_t blockLast = min(last, blockFirst + blockSize);
+        size_t blockCounts[3] = {0, 0, 0};
+        for (size_t i = blockFirst; i < blockLast; i++) {
+            double value = nodes[i]->getPoint()[d];
+            unsigned char group = value < pivot ? 0 : (value == pivot ? 1 : 2);
+            groups[i - first] = group;
+            blockCounts[group]++;
+        }
+        copy(blockCounts, blockCounts + 3, counts.begin() + 3 * block);
+    }, 1);
+
+    size_t groupFirst[3] = {0, 0, 0};
+    for (unsigned int block = 0; block < threads; block++) {
+        groupFirst[1] += counts[3 * block];
+        groupFirst[2] += counts[3 * block] + counts[3 * block + 1];
+    }
+    parallelFor(threads, threads, [&](size_t block) {
+        size_t blockFirst = min(last, first + block * blockSize);
+        size_t blockLast = min(last, blockFirst + blockSize);
+        size_t slots[3] = {groupFirst[0], groupFirst[1], groupFirst[2]};
+        for (size_t b = 0; b < block; b++) {
+            for (int group = 0; group < 3; group++) {
+                slots[group] += counts[3 * b + group];
+            }
+        }
+        for (size_t i = blockFirst; i < blockLast; i++) {
+            scratch[slots[groups[i - first]]++] = nodes[i];
+        }
+    }, 1);
+    parallelFor(threads, threads, [&](size_t block) {
+        size_t blockFirst = min(last, first + block * blockSize);
+        size_t blockLast = min(last, blockFirst + blockSize);
+        copy(scratch.begin() + (blockFirst - first), scratch.begin() + (blockLast - first), nodes.begin() + blockFirst);
+    }, 1);
+
+    PivotSplit split = {first + groupFirst[1], first + groupFirst[2]};
+    return split;
+}
+
+/**
+ * Places in nodes[mid] the node nth_element would put there, comparing coordinate d, with every node before the
+ * returned index smaller than it and every other node no smaller. Large ranges are narrowed by splitAroundPivot
+ * passes on the given threads, each around the median of an evenly spaced sample; nth_element and partition
+ * finish once the range holding mid is small.
+ */
+size_t selectMedian(vector<Node *> &nodes, size_t first, size_t mid, size_t last, unsigned int d, unsigned int threads) {
+    size_t low = first;
+    size_t high = last;
+    if (last - first >= PARALLEL_BUILD_MIN_NODES) {
+        vector<Node *> scratch(last - first);
+        vector<unsigned char> groups(last - first);
+        while (high - low >= PARALLEL_BUILD_MIN_NODES) {
+            double sample[SELECT_SAMPLE_SIZE];
+            for (size_t i = 0; i < SELECT_SAMPLE_SIZE; i++) {
+                sample[i] = nodes[low + (high - low) * i / SELECT_SAMPLE_SIZE]->getPoint()[d];
+            }
+            nth_element(sample, sample + SELECT_SAMPLE_SIZE / 2, sample + SELECT_SAMPLE_SIZE);
+
+            // the pivot is a point of the range, so the equal group is never empty and every pass narrows the range;
+            // whatever a pass leaves below low is smaller than the median, whatever it leaves from high on is larger
+            PivotSplit split = splitAroundPivot(nodes, scratch, groups, low, high, d, sample[SELECT_SAMPLE_SIZE / 2], threads);
+            if (mid < split.equalFirst) {
+                high = split.equalFirst;
+            } else if (mid >= split.greaterFirst) {
+                low = split.greaterFirst;
+            } else {
+                return split.equalFirst;
+            }
+        }
+    }
+
+    nth_element(nodes.begin() + low, nodes.begin() + mid, nodes.begin() + high, [d](Node *a, Node *b) {
+        return a->getPoint()[d] < b->getPoint()[d];
+    });
+    double median = nodes[mid]->getPoint()[d];
+    return partition(nodes.begin() + low, nodes.begin() + mid, [d, median](Node *n) {
+        return n->getPoint()[d] < median;
+    }) - nodes.begin();
+}
+
+Node *KDTree::recurseBuild(vector<Node *> &nodes, size_t first, size_t last, unsigned int depth, unsigned int parallelLevels) {
+    if (first >= last) {
+        return nullptr;
     }
     unsigned int d = depth % k;
+    size_t mid = first + (last - first) / 2;
+
+    // points equal to the median must go right, so pull the smallest median-valued point up as the root;
+    // the selection of a level still building its halves on separate threads uses all of their threads
+    size_t splitIndex = selectMedian(nodes, first, mid, last, d, 1u << parallelLevels);
+    swap(nodes[splitIndex], nodes[mid]);
 
-    if (point[d] < node->getPoint()[d]) {
-        node->setLeftNode(recurseInsertion(node->getLeftNode(), point, depth + 1));
+    // the halves are disjoint ranges of nodes, so building them concurrently gives the same tree
+    Node *node = nodes[splitIndex];
+    if (parallelLevels > 0 && last - first >= PARALLEL_BUILD_MIN_NODES) {
+        Node *left = nullptr;
+        thread leftBuilder([&]() {
+            left = recurseBuild(nodes, first, splitIndex, depth + 1, parallelLevels - 1);
+        });
+        node->setRightNode(recurseBuild(nodes, splitIndex + 1, last, depth + 1, parallelLevels - 1));
+        leftBuilder.join();
+        node->setLeftNode(left);
     } else {
-        node->setRightNode(recurseInsertion(node->getRightNode(), point, depth + 1));
+        node->setLeftNode(recurseBuild(nodes, first, splitIndex, depth + 1));
+        node->setRightNode(recurseBuild(nodes, splitIndex + 1, last, depth + 1));
     }
-
+    node->setSubtreeSize(last - first);
     return node;
 }
 
-Node *KDTree::recurseGetNode(Node *node, vector<double> point, unsigned int depth) {
-    if (node == nullptr) {
-        return nullptr;
+Node *KDTree::rebuildSubtree(Node *node, unsigned int depth) {
+    vector<Node *> nodes;
+    nodes.reserve(subtreeSize(node));
+    vector<Node *> stack(1, node);
+    while (!stack.empty()) {
+        Node *current = stack.back();
+        stack.pop_back();
+        if (current != nullptr) {
+            nodes.push_back(current);
+            stack.push_back(current->getLeftNode());
+            stack.push_back(current->getRightNode());
+        }
     }
+    return recurseBuild(nodes, 0, nodes.size(), depth);
+}
 
-    if (node->getPoint() == point) {
-        return node;
+void KDTree::rebalanceAfterInsert(PointView point) {
+    // follow the insertion path again, remembering the lowest node whose child on the path is too heavy
+    Node *parent = nullptr;
+    Node *scapegoat = nullptr;
+    Node *scapegoatParent = nullptr;
+    unsigned int scapegoatDepth = 0;
+    Node *node = root;
+    unsigned int depth = 0;
+    while (node != nullptr) {
+        unsigned int d = depth % k;
+        Node *next = point[d] < node->getPoint()[d] ? node->getLeftNode() : node->getRightNode();
+        if (subtreeSize(next) > alpha * node->getSubtreeSize()) {
+            scapegoat = node;
+            scapegoatParent = parent;
+            scapegoatDepth = depth;
+        }
+        parent = node;
+        node = next;
+        depth++;
     }
-    unsigned int d = depth % k;
 
-    if (point[d] < node->getPoint()[d]) {
-        return recurseGetNode(node->getLeftNode(), point, depth + 1);
+    // the new node sits at depth - 1, only rebuild when that is deeper than an alpha-balanced tree allows
+    double maxDepth = log((double)maxNodeCount) / log(1.0 / alpha);
+    if (scapegoat == nullptr || depth - 1 <= maxDepth) {
+        return;
+    }
+
+    Node *rebuilt = rebuildSubtree(scapegoat, scapegoatDepth);
+    if (scapegoatParent == nullptr) {
+        root = rebuilt;
+    } else if (scapegoatParent->getLeftNode() == scapegoat) {
+        scapegoatParent->setLeftNode(rebuilt);
     } else {
-        return recurseGetNode(node->getRightNode(), point, depth + 1);
+        scapegoatParent->setRightNode(rebuilt);
     }
 }
 
-Node* fminNode(Node* currentNode, Node* left, Node* right, int axis) {
-    if (left != nullptr && left->getPoint()[axis] < currentNode->getPoint()[axis]) {
-        return left;
-    } else if (right != nullptr && right->getPoint()[axis] < currentNode->getPoint()[axis]) {
-        return right;
+unsigned int KDTree::updateSizes(Node *node) {
+    // preorder puts every node before its children, so walking it backwards sizes the children first
+    vector<Node *> preorder;
+    vector<Node *> stack(1, node);
+    while (!stack.empty()) {
+        Node *current = stack.back();
+        stack.pop_back();
+        if (current != nullptr) {
+            preorder.push_back(current);
+            stack.push_back(current->getRightNode());
+            stack.push_back(current->getLeftNode());
+        }
     }
-    return currentNode;
+    for (size_t i = preorder.size(); i > 0; i--) {
+        Node *current = preorder[i - 1];
+        current->setSubtreeSize(1 + subtreeSize(current->getLeftNode()) + subtreeSize(current->getRightNode()));
+    }
+    return subtreeSize(node);
 }
 
-Node* KDTree::recurseFindMinimum(Node *node, unsigned int axis, unsigned int depth) {
-    if (node == nullptr) {
-        return nullptr;
+void KDTree::setSelfBalancing(bool enabled, double alpha) {
+    if (alpha <= 0.5 || alpha >= 1.0) {
+        throw invalid_argument("Incorrect alpha provided. Please enter an alpha strictly between 0.5 and 1.");
+    }
+    selfBalancing = enabled;
+    this->alpha = alpha;
+    if (enabled) {
+        // nodes attached with setRoot/setLeftNode/setRightNode may carry stale sizes
+        maxNodeCount = updateSizes(root);
+    }
+}
+
+bool KDTree::isSelfBalancing() {
+    return selfBalancing;
+}
+
+void KDTree::setLazyDeletion(bool enabled, double compactionThreshold) {
+    if (compactionThreshold <= 0.0 || compactionThreshold > 1.0) {
+        throw invalid_argument("Incorrect compaction threshold provided. Please enter a threshold greater than 0 and at most 1.");
+    }
+    if (!enabled && deadCount > 0) {
+        compact();
+    }
+    if (enabled && !lazyDeletion) {
+        // the dead ratio is taken against the root's subtree size, which hand-attached nodes may have left stale
+        updateSizes(root);
     }
+    lazyDeletion = enabled;
+    this->compactionThreshold = compactionThreshold;
+}
 
-    unsigned int d = depth % k;
-    if (d == axis) {
-        if (node->getLeftNode() == nullptr) {
+bool KDTree::isLazyDeletion() {
+    return lazyDeletion;
+}
+
+double KDTree::deadRatio() {
+    if (root == nullptr) {
+        return 0.0;
+    }
+    return (double)deadCount / root->getSubtreeSize();
+}
+
+Node* KDTree::compact() {
+    vector<Node *> live;
+    live.reserve(subtreeSize(root) - deadCount);
+    vector<Node *> stack(1, root);
+    while (!stack.empty()) {
+        Node *node = stack.back();
+        stack.pop_back();
+        if (node == nullptr) {
+            continue;
+        }
+        stack.push_back(node->getLeftNode());
+        stack.push_back(node->getRightNode());
+        if (node->isDeleted()) {
+            pool.release(node);
+        } else {
+            live.push_back(node);
+        }
+    }
+
+    root = recurseBuild(live, 0, live.size(), 0);
+    deadCount = 0;
+    maxNodeCount = live.size();
+    return root;
+}
+
+Node *KDTree::findNode(const double *point) {
+    STATS_RESET();
+    Node *node = root;
+    unsigned int depth = 0;
+    while (node != nullptr) {
+        STATS_VISIT(depth);
+        if (!node->isDeleted() && node->getPoint() == PointView(point, k)) {
             return node;
         }
+        unsigned int d = depth % k;
+        node = point[d] < node->getPoint()[d] ? node->getLeftNode() : node->getRightNode();
+        depth++;
+    }
+    return nullptr;
+}
 
-        return recurseFindMinimum(node->getLeftNode(), axis, depth + 1);
+Node* KDTree::findMinimum(Node *node, unsigned int axis, unsigned int depth) {
+    Node *minimum = nullptr;
+    TraversalStack<Branch> stack;
+    if (node != nullptr) {
+        stack.push(makeBranch(node, depth, 0.0));
     }
+    while (!stack.empty()) {
+        Branch branch = stack.pop();
+        Node *current = branch.node;
+        if (minimum == nullptr || current->getPoint()[axis] < minimum->getPoint()[axis]) {
+            minimum = current;
+        }
 
-    return fminNode(
-        node,
-        recurseFindMinimum(node->getLeftNode(), axis, depth + 1),
-        recurseFindMinimum(node->getRightNode(), axis, depth + 1),
-        axis
-    );
+        // below a node split on the axis, only its left subtree can hold smaller values
+        if (branch.depth % k != axis && current->getRightNode() != nullptr) {
+            stack.push(makeBranch(current->getRightNode(), branch.depth + 1, 0.0));
+        }
+        if (current->getLeftNode() != nullptr) {
+            stack.push(makeBranch(current->getLeftNode(), branch.depth + 1, 0.0));
+        }
+    }
+    return minimum;
 }
 
-Node* KDTree::recurseRemoveNode(Node *node, vector<double> point, unsigned int depth) {
-    if (node == nullptr) {
-        return nullptr;
-    }
+void KDTree::removeFromTree(PointView point) {
+    // copied: removal overwrites node coordinates, which the view may point into
+    vector<double> target(point.begin(), point.end());
+    vector<Node *> path;
+    Node *parent = nullptr;
+    Node *node = root;
+    unsigned int depth = 0;
 
-    unsigned int d = depth % k;
+    while (node != nullptr) {
+        unsigned int d = depth % k;
+        if (node->getPoint() == target) {
+            if (node->isLeaf()) {
+                break;
+            }
 
-    if (node->getPoint() == point) {
-        if (node->getRightNode() != nullptr) {
-            Node* rSubMinNode = findMinimumAxisValueFromNode(node->getRightNode(), d);
-            node->setPoint(rSubMinNode->getPoint());
-            node->setRightNode(recurseRemoveNode(node->getRightNode(), rSubMinNode->getPoint(), depth + 1));
-        } else if (node->getLeftNode() != nullptr) {
-            Node* lSubMinNode = findMinimumAxisValueFromNode(node->getLeftNode(), d);
-            node->setPoint(lSubMinNode->getPoint());
-            node->setRightNode(recurseRemoveNode(node->getLeftNode(), lSubMinNode->getPoint(), depth + 1));
-            node->setLeftNode(nullptr);
-        } else {
-            delete node;
-            return nullptr;
+            // take the minimum of a branch as the node's point, then go on to remove that minimum from the branch
+            Node *replacement = nullptr;
+            if (node->getRightNode() != nullptr) {
+                replacement = findMinimum(node->getRightNode(), d, depth + 1);
+            } else {
+                replacement = findMinimum(node->getLeftNode(), d, depth + 1);
+                node->setRightNode(node->getLeftNode());
+                node->setLeftNode(nullptr);
+            }
+            node->setPoint(replacement->getPoint());
+            node->setId(replacement->getId());
+            target.assign(replacement->getPoint().begin(), replacement->getPoint().end());
+            path.push_back(node);
+            parent = node;
+            node = node->getRightNode();
+            depth++;
+            continue;
         }
-        return node;
+
+        path.push_back(node);
+        parent = node;
+        node = target[d] < node->getPoint()[d] ? node->getLeftNode() : node->getRightNode();
+        depth++;
     }
 
-    if (point[d] < node->getPoint()[d]) {
-        node->setLeftNode(recurseRemoveNode(node->getLeftNode(), point, depth + 1));
+    if (node == nullptr) {
+        return;
+    }
+    if (parent == nullptr) {
+        root = nullptr;
+    } else if (parent->getLeftNode() == node) {
+        parent->setLeftNode(nullptr);
     } else {
-        node->setRightNode(recurseRemoveNode(node->getRightNode(), point, depth + 1));
+        parent->setRightNode(nullptr);
+    }
+    pool.release(node);
+    for (Node *ancestor : path) {
+        ancestor->setSubtreeSize(ancestor->getSubtreeSize() - 1);
     }
-
-    return node;
 }
 
-double KDTree::squaredDistance(vector<double> a, vector<double> b) {
+double KDTree::squaredDistance(const double *a, const double *b) {
+    STATS_DISTANCE();
     double distance = 0.0;
     for (unsigned int i = 0; i < k; i++) {
         double diff = a[i] - b[i];
@@ -116,96 +435,612 @@ double KDTree::squaredDistance(vector<double> a, vector<double> b) {
     return distance;
 }
 
-void KDTree::recurseNN(Node *node, Node *target, Node*& currentBest, double& currentBestDist, unsigned int depth)
+void KDTree::searchNN(const double *target, bool includeExactMatches, Node*& currentBest, double& currentBestDist)
 {
-    if (node == nullptr) {
+    STATS_RESET();
+    TraversalStack<Branch> stack;
+    if (root != nullptr) {
+        stack.push(makeBranch(root, 0, 0.0));
+    }
+
+    while (!stack.empty()) {
+        Branch branch = stack.pop();
+        if (branch.bound >= currentBestDist) {
+            STATS_PRUNE();
+            continue;
+        }
+        STATS_BRANCH(branch.depth);
+
+        // follow the target down to a leaf, leaving the other branch of every node on the stack
+        Node *node = branch.node;
+        unsigned int depth = branch.depth;
+        while (node != nullptr) {
+            STATS_VISIT(depth);
+            unsigned int d = depth % k;
+            PointView point = node->getPoint();
+            double currentDist = squaredDistance(point.data(), target);
+            if (!node->isDeleted() && (includeExactMatches || currentDist > 0) && (currentBest == nullptr || currentDist < currentBestDist))
+            {
+                currentBest = node;
+                currentBestDist = currentDist;
+            }
+
+            double currentDistToPlane = target[d] - point[d];
+            Node *nextBranch = currentDistToPlane < 0 ? node->getLeftNode() : node->getRightNode();
+            Node *otherBranch = currentDistToPlane < 0 ? node->getRightNode() : node->getLeftNode();
+            if (otherBranch != nullptr) {
+                stack.push(makeBranch(otherBranch, depth + 1, max(branch.bound, currentDistToPlane * currentDistToPlane)));
+            }
+
+            node = nextBranch;
+            depth++;
+        }
+    }
+}
+
+bool neighborIsCloser(const KDTree::Neighbor &a, const KDTree::Neighbor &b) {
+    return a.distance < b.distance;
+}
+
+void KDTree::searchKNN(const double *query, unsigned int count, bool includeExactMatches, vector<Neighbor> &heap)
+{
+    STATS_RESET();
+    TraversalStack<Branch> stack;
+    if (root != nullptr) {
+        stack.push(makeBranch(root, 0, 0.0));
+    }
+
+    // heap holds squared distances while searching, its front is the farthest of the current candidates
+    while (!stack.empty()) {
+        Branch branch = stack.pop();
+        if (heap.size() == count && branch.bound >= heap.front().distance) {
+            STATS_PRUNE();
+            continue;
+        }
+        STATS_BRANCH(branch.depth);
+
+        Node *node = branch.node;
+        unsigned int depth = branch.depth;
+        while (node != nullptr) {
+            STATS_VISIT(depth);
+            unsigned int d = depth % k;
+            PointView point = node->getPoint();
+            double currentDist = squaredDistance(point.data(), query);
+            if (!node->isDeleted() && (includeExactMatches || currentDist > 0)) {
+                if (heap.size() < count) {
+                    Neighbor neighbor = {node, currentDist};
+                    heap.push_back(neighbor);
+                    push_heap(heap.begin(), heap.end(), neighborIsCloser);
+                } else if (currentDist < heap.front().distance) {
+                    pop_heap(heap.begin(), heap.end(), neighborIsCloser);
+                    heap.back().node = node;
+                    heap.back().distance = currentDist;
+                    push_heap(heap.begin(), heap.end(), neighborIsCloser);
+                }
+            }
+
+            double currentDistToPlane = query[d] - point[d];
+            Node *nextBranch = currentDistToPlane < 0 ? node->getLeftNode() : node->getRightNode();
+            Node *otherBranch = currentDistToPlane < 0 ? node->getRightNode() : node->getLeftNode();
+            if (otherBranch != nullptr) {
+                stack.push(makeBranch(otherBranch, depth + 1, max(branch.bound, currentDistToPlane * currentDistToPlane)));
+            }
+
+            node = nextBranch;
+            depth++;
+        }
+    }
+}
+
+vector<KDTree::Neighbor> KDTree::kNearest(PointView query, unsigned int count, bool includeExactMatches) {
+    vector<Neighbor> neighbors;
+    kNearest(query, count, neighbors, includeExactMatches);
+    return neighbors;
+}
+
+void KDTree::kNearest(PointView query, unsigned int count, vector<Neighbor> &neighbors, bool includeExactMatches) {
+    checkDimensions(query);
+    neighbors.clear();
+    if (count == 0) {
         return;
     }
+    neighbors.reserve(count);
 
-    unsigned int d = depth % k;
-    double currentDist = squaredDistance(node->getPoint(), target->getPoint());
-    if (currentBest == nullptr || (currentDist < currentBestDist && currentDist > 0))
-    {
-        currentBest = node;
-        currentBestDist = currentDist;
+    searchKNN(query.data(), count, includeExactMatches, neighbors);
+
+    sort_heap(neighbors.begin(), neighbors.end(), neighborIsCloser);
+    for (Neighbor &neighbor : neighbors) {
+        neighbor.distance = sqrt(neighbor.distance);
     }
+}
 
-    Node* nextBranch = nullptr;
-    Node* otherBranch = nullptr;
+bool branchIsFarther(const Branch &a, const Branch &b) {
+    return a.bound > b.bound;
+}
 
-    if (target->getPoint()[d] < node->getPoint()[d]) {
-        nextBranch = node->getLeftNode();
-        otherBranch = node->getRightNode();
-    } else {
-        nextBranch = node->getRightNode();
-        otherBranch = node->getLeftNode();
+KDTree::Neighbor KDTree::approximateNearestNeighbor(PointView query, double epsilon, size_t maxVisits, bool includeExactMatches) {
+    checkDimensions(query);
+    if (epsilon < 0) {
+        throw invalid_argument("Incorrect epsilon provided. Please enter an epsilon of 0 or more.");
     }
 
-    recurseNN(nextBranch, target, currentBest, currentBestDist, depth + 1);
+    Neighbor best = {nullptr, numeric_limits<double>::infinity()};
+    // squared distances are compared, so the (1 + epsilon) factor is squared too
+    double errorFactor = (1.0 + epsilon) * (1.0 + epsilon);
+    size_t visits = 0;
+    STATS_RESET();
 
-    double currentDistToPlane = target->getPoint()[d] - node->getPoint()[d];
-    if ((currentDistToPlane * currentDistToPlane) < currentBestDist) {
-        recurseNN(otherBranch, target, currentBest, currentBestDist, depth + 1);
+    vector<Branch> pending;
+    if (root != nullptr) {
+        Branch start = {root, 0, 0.0};
+        pending.push_back(start);
     }
+
+    while (!pending.empty()) {
+        pop_heap(pending.begin(), pending.end(), branchIsFarther);
+        Branch branch = pending.back();
+        pending.pop_back();
+        if (branch.bound * errorFactor >= best.distance) {
+            break;
+        }
+        STATS_BRANCH(branch.depth);
+
+        // walk down to a leaf following the query, leaving the far side of every split for later
+        Node *node = branch.node;
+        unsigned int depth = branch.depth;
+        while (node != nullptr) {
+            if (maxVisits > 0 && visits == maxVisits) {
+                pending.clear();
+                break;
+            }
+            visits++;
+            STATS_VISIT(depth);
+
+            unsigned int d = depth % k;
+            PointView point = node->getPoint();
+            double currentDist = squaredDistance(point.data(), query.data());
+            if (!node->isDeleted() && (includeExactMatches || currentDist > 0) && currentDist < best.distance) {
+                best.node = node;
+                best.distance = currentDist;
+            }
+
+            double currentDistToPlane = query[d] - point[d];
+            Node *nextBranch = currentDistToPlane < 0 ? node->getLeftNode() : node->getRightNode();
+            Node *otherBranch = currentDistToPlane < 0 ? node->getRightNode() : node->getLeftNode();
+
+            double otherBound = max(branch.bound, currentDistToPlane * currentDistToPlane);
+            if (otherBranch != nullptr && otherBound * errorFactor < best.distance) {
+                Branch other = {otherBranch, depth + 1, otherBound};
+                pending.push_back(other);
+                push_heap(pending.begin(), pending.end(), branchIsFarther);
+            } else if (otherBranch != nullptr) {
+                STATS_PRUNE();
+            }
+
+            node = nextBranch;
+            depth++;
+        }
+    }
+
+    best.distance = sqrt(best.distance);
+    return best;
 }
 
-void KDTree::addNodeToInRangeList(Node *node, KDTree::Bounds b, vector<Node*>& nodesInRange) {
-    bool inX = true;
-    bool inY = true;
-    bool inZ = true;
-    if (k > 0) {
-        inX = b.minX <= node->getPoint()[0] && node->getPoint()[0] <= b.maxX;
+template <typename Visit>
+bool KDTree::traverseRadius(const double *query, double radiusSquared, Visit visit) {
+    STATS_RESET();
+    TraversalStack<Branch> stack;
+    if (root != nullptr) {
+        stack.push(makeBranch(root, 0, 0.0));
     }
 
-    if (k > 1) {
-        inY = b.minY <= node->getPoint()[1] && node->getPoint()[1] <= b.maxY;
+    while (!stack.empty()) {
+        Branch branch = stack.pop();
+        if (branch.bound > radiusSquared) {
+            STATS_PRUNE();
+            continue;
+        }
+        STATS_BRANCH(branch.depth);
+
+        Node *node = branch.node;
+        unsigned int depth = branch.depth;
+        while (node != nullptr) {
+            STATS_VISIT(depth);
+            unsigned int d = depth % k;
+            PointView point = node->getPoint();
+            double currentDist = squaredDistance(point.data(), query);
+            if (!node->isDeleted() && currentDist <= radiusSquared && !visit(node, currentDist)) {
+                return false;
+            }
+
+            double currentDistToPlane = query[d] - point[d];
+            Node *nextBranch = currentDistToPlane < 0 ? node->getLeftNode() : node->getRightNode();
+            Node *otherBranch = currentDistToPlane < 0 ? node->getRightNode() : node->getLeftNode();
+            if (otherBranch != nullptr) {
+                stack.push(makeBranch(otherBranch, depth + 1, max(branch.bound, currentDistToPlane * currentDistToPlane)));
+            }
+
+            node = nextBranch;
+            depth++;
+        }
     }
+    return true;
+}
 
-    if (k > 2) {
-        inZ = b.minZ <= node->getPoint()[2] && node->getPoint()[2] <= b.maxZ;
+vector<KDTree::Neighbor> KDTree::radiusSearch(PointView query, double radius) {
+    vector<Neighbor> neighbors;
+    radiusSearch(query, radius, neighbors);
+    return neighbors;
+}
+
+void KDTree::radiusSearch(PointView query, double radius, vector<Neighbor> &neighbors) {
+    checkDimensions(query);
+    if (radius >= 0) {
+        traverseRadius(query.data(), radius * radius, [&neighbors](Node *node, double distance) {
+            Neighbor neighbor = {node, sqrt(distance)};
+            neighbors.push_back(neighbor);
+            return true;
+        });
     }
+}
 
-    if (inX && inY && inZ) {
-        nodesInRange.push_back(node);
+size_t KDTree::radiusCount(PointView query, double radius) {
+    checkDimensions(query);
+    size_t found = 0;
+    if (radius >= 0) {
+        traverseRadius(query.data(), radius * radius, [&found](Node *, double) {
+            found++;
+            return true;
+        });
     }
+    return found;
 }
 
-void KDTree::recurseGetNodesInRange(Node *node, KDTree::Bounds b, vector<Node*>& nodesInRange) {
-    if (node == nullptr) {
+/**
+ * JoinTree struct is a tree flattened in preorder for distanceJoin. Entry i holds the node, the indices of its
+ * children (NO_CHILD if absent) and the number of nodes in its subtree; its point is at points[i * k] and the
+ * bounding box of its subtree at mins/maxs[i * k]. Copying the coordinates keeps the join's memory accesses
+ * contiguous.
+ */
+struct JoinTree {
+    static const size_t NO_CHILD = (size_t)-1;
+
+    struct Entry {
+        Node *node;
+        size_t left;
+        size_t right;
+        size_t size;
+    };
+    vector<Entry> entries;
+    vector<double> points;
+    vector<double> mins;
+    vector<double> maxs;
+};
+
+/**
+ * JoinFrame struct is a pair of subtrees waiting on the explicit stack of distanceJoin. A side flagged as a
+ * point stands for its node's point alone instead of its whole subtree.
+ */
+struct JoinFrame {
+    size_t a;
+    size_t b;
+    bool aIsPoint;
+    bool bIsPoint;
+};
+
+/**
+ * PendingJoinNode struct is a node waiting to be flattened with the index of its parent's entry (NO_CHILD for
+ * the root) and the side of the parent it hangs on
+ */
+struct PendingJoinNode {
+    Node *node;
+    size_t parent;
+    bool isRight;
+};
+
+static void flattenForJoin(Node *root, unsigned int k, JoinTree &tree) {
+    tree.entries.reserve(root->getSubtreeSize());
+    tree.points.reserve((size_t)root->getSubtreeSize() * k);
+
+    TraversalStack<PendingJoinNode> stack;
+    PendingJoinNode start = {root, JoinTree::NO_CHILD, false};
+    stack.push(start);
+    while (!stack.empty()) {
+        PendingJoinNode pending = stack.pop();
+        size_t index = tree.entries.size();
+        JoinTree::Entry entry = {pending.node, JoinTree::NO_CHILD, JoinTree::NO_CHILD, 1};
+        tree.entries.push_back(entry);
+        tree.points.insert(tree.points.end(), pending.node->getPoint().begin(), pending.node->getPoint().end());
+        if (pending.parent != JoinTree::NO_CHILD) {
+            JoinTree::Entry &parent = tree.entries[pending.parent];
+            (pending.isRight ? parent.right : parent.left) = index;
+        }
+        if (pending.node->getRightNode() != nullptr) {
+            PendingJoinNode right = {pending.node->getRightNode(), index, true};
+            stack.push(right);
+        }
+        if (pending.node->getLeftNode() != nullptr) {
+            PendingJoinNode left = {pending.node->getLeftNode(), index, false};
+            stack.push(left);
+        }
+    }
+
+    // in preorder children come after their parent, so walking backwards completes every child first
+    tree.mins = tree.points;
+    tree.maxs = tree.points;
+    for (size_t i = tree.entries.size(); i-- > 0;) {
+        JoinTree::Entry &entry = tree.entries[i];
+        size_t children[2] = {entry.left, entry.right};
+        for (size_t child : children) {
+            if (child == JoinTree::NO_CHILD) {
+                continue;
+            }
+            entry.size += tree.entries[child].size;
+            for (unsigned int d = 0; d < k; d++) {
+                tree.mins[i * k + d] = min(tree.mins[i * k + d], tree.mins[child * k + d]);
+                tree.maxs[i * k + d] = max(tree.maxs[i * k + d], tree.maxs[child * k + d]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief lower bound of the squared distance between the points of the two sides of a join frame, their exact
+ * squared distance when both sides are points
+ */
+static double joinBound(const JoinTree &a, const JoinTree &b, const JoinFrame &frame, unsigned int k) {
+    const double *aMin = frame.aIsPoint ? &a.points[frame.a * k] : &a.mins[frame.a * k];
+    const double *aMax = frame.aIsPoint ? aMin : &a.maxs[frame.a * k];
+    const double *bMin = frame.bIsPoint ? &b.points[frame.b * k] : &b.mins[frame.b * k];
+    const double *bMax = frame.bIsPoint ? bMin : &b.maxs[frame.b * k];
+    double bound = 0.0;
+    for (unsigned int d = 0; d < k; d++) {
+        double gap = max(0.0, max(aMin[d] - bMax[d], bMin[d] - aMax[d]));
+        bound += gap * gap;
+    }
+    return bound;
+}
+
+/**
+ * @brief splits the larger side of a join frame into its node's point and its two children
+ *
+ * @return bool false if both sides are single points and the frame cannot be split
+ */
+template <typename Push>
+static bool splitJoinFrame(const JoinTree &a, const JoinTree &b, const JoinFrame &frame, Push push) {
+    size_t aSize = frame.aIsPoint ? 1 : a.entries[frame.a].size;
+    size_t bSize = frame.bIsPoint ? 1 : b.entries[frame.b].size;
+    if (aSize == 1 && bSize == 1) {
+        return false;
+    }
+    bool splitA = aSize >= bSize;
+    const JoinTree &side = splitA ? a : b;
+    const JoinTree::Entry &entry = side.entries[splitA ? frame.a : frame.b];
+    size_t parts[3] = {splitA ? frame.a : frame.b, entry.left, entry.right};
+    for (int i = 0; i < 3; i++) {
+        if (parts[i] == JoinTree::NO_CHILD) {
+            continue;
+        }
+        JoinFrame child = frame;
+        bool isPoint = i == 0 || side.entries[parts[i]].size == 1;
+        if (splitA) {
+            child.a = parts[i];
+            child.aIsPoint = isPoint;
+        } else {
+            child.b = parts[i];
+            child.bIsPoint = isPoint;
+        }
+        push(child);
+    }
+    return true;
+}
+
+void KDTree::distanceJoin(KDTree &other, double epsilon, const function<void(Node *, Node *, double)> &visitor, unsigned int threadCount) {
+    if (other.k != k) {
+        throw invalid_argument("Incorrect number of dimensions provided. Both trees must have the same dimensions.");
+    }
+    if (epsilon < 0 || root == nullptr || other.root == nullptr) {
+        return;
+    }
+
+    JoinTree a;
+    JoinTree b;
+    flattenForJoin(root, k, a);
+    flattenForJoin(other.root, k, b);
+    double epsilonSquared = epsilon * epsilon;
+    unsigned int dims = k;
+
+    // two single points: the bound is their exact squared distance
+    auto match = [&a, &b, &visitor, epsilonSquared, dims](const JoinFrame &frame) {
+        double distance = joinBound(a, b, frame, dims);
+        Node *aNode = a.entries[frame.a].node;
+        Node *bNode = b.entries[frame.b].node;
+        if (distance <= epsilonSquared && !aNode->isDeleted() && !bNode->isDeleted()) {
+            visitor(aNode, bNode, sqrt(distance));
+        }
+    };
+    auto run = [&a, &b, &match, epsilonSquared, dims](JoinFrame start) {
+        TraversalStack<JoinFrame> stack;
+        stack.push(start);
+        while (!stack.empty()) {
+            JoinFrame frame = stack.pop();
+            if (joinBound(a, b, frame, dims) > epsilonSquared) {
+                continue;
+            }
+            bool split = splitJoinFrame(a, b, frame, [&stack, &match](const JoinFrame &child) {
+                if (child.aIsPoint && child.bIsPoint) {
+                    match(child);
+                } else {
+                    stack.push(child);
+                }
+            });
+            if (!split) {
+                match(frame);
+            }
+        }
+    };
+
+    JoinFrame top = {0, 0, a.entries[0].size == 1, b.entries[0].size == 1};
+    unsigned int threads = resolveThreadCount(threadCount);
+    if (threads <= 1) {
+        run(top);
         return;
     }
 
-    recurseGetNodesInRange(node->getLeftNode(), b, nodesInRange);
-    addNodeToInRangeList(node, b, nodesInRange);
-    recurseGetNodesInRange(node->getRightNode(), b, nodesInRange);
+    // expand the pair traversal breadth first until there are enough independent tasks to share out
+    vector<JoinFrame> tasks;
+    vector<JoinFrame> pending(1, top);
+    size_t next = 0;
+    size_t wanted = (size_t)threads * 16;
+    while (next < pending.size() && tasks.size() + pending.size() - next < wanted) {
+        JoinFrame frame = pending[next++];
+        if (joinBound(a, b, frame, dims) > epsilonSquared) {
+            continue;
+        }
+        if (!splitJoinFrame(a, b, frame, [&pending](const JoinFrame &child) { pending.push_back(child); })) {
+            tasks.push_back(frame);
+        }
+    }
+    tasks.insert(tasks.end(), pending.begin() + next, pending.end());
+    parallelFor(tasks.size(), threads, [&run, &tasks](size_t i) {
+        run(tasks[i]);
+    }, 1);
+}
+
+bool KDTree::visitRadius(PointView query, double radius, const function<bool(Node *, double)> &visitor) {
+    checkDimensions(query);
+    if (radius < 0) {
+        return true;
+    }
+    return traverseRadius(query.data(), radius * radius, [&visitor](Node *node, double distance) {
+        return visitor(node, sqrt(distance));
+    });
+}
+
+bool KDTree::isInRange(Node *node, const double *minCorner, const double *maxCorner) {
+    if (node->isDeleted()) {
+        return false;
+    }
+    PointView point = node->getPoint();
+    for (unsigned int i = 0; i < k; i++) {
+        if (point[i] < minCorner[i] || maxCorner[i] < point[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Visit>
+bool KDTree::traverseRange(const double *minCorner, const double *maxCorner, Visit visit) {
+    // in-order: nodes are stacked on the way down the left side and visited on the way back
+    STATS_RESET();
+    TraversalStack<Branch> stack;
+    Branch current = makeBranch(root, 0, 0.0);
+    while (true) {
+        // the left subtree only holds values smaller than the split, the right subtree values greater or equal
+        while (current.node != nullptr) {
+            STATS_VISIT(current.depth);
+            stack.push(current);
+            unsigned int d = current.depth % k;
+            if (minCorner[d] < current.node->getPoint()[d]) {
+                current = makeBranch(current.node->getLeftNode(), current.depth + 1, 0.0);
+            } else {
+                if (current.node->getLeftNode() != nullptr) {
+                    STATS_PRUNE();
+                }
+                current.node = nullptr;
+            }
+        }
+        if (stack.empty()) {
+            return true;
+        }
+
+        Branch branch = stack.pop();
+        if (isInRange(branch.node, minCorner, maxCorner) && !visit(branch.node)) {
+            return false;
+        }
+        unsigned int d = branch.depth % k;
+        if (branch.node->getPoint()[d] <= maxCorner[d]) {
+            current = makeBranch(branch.node->getRightNode(), branch.depth + 1, 0.0);
+        } else if (branch.node->getRightNode() != nullptr) {
+            STATS_PRUNE();
+        }
+    }
 }
 
 Node* KDTree::nearestNeighborSearch(Node* target) {
     Node *best = nullptr;
     double bestDist = numeric_limits<double>::infinity();
 
-    recurseNN(root, target, best, bestDist, 0);
+    searchNN(target->getPoint().data(), false, best, bestDist);
     return best;
 }
 
-KDTree::Bounds KDTree::makeRange(vector<double> pointOfOrigin, double width, double height, double length) {
-    Bounds b;
-    if (k > 0) {
-        double ox = pointOfOrigin[0];
-        b.minX = ox;
-        b.maxX = ox + width;
+Node* KDTree::nearestNeighborSearch(PointView query, bool includeExactMatches) {
+    checkDimensions(query);
+    Node *best = nullptr;
+    double bestDist = numeric_limits<double>::infinity();
+
+    searchNN(query.data(), includeExactMatches, best, bestDist);
+    return best;
+}
+
+KDTree::IdNeighbor KDTree::nearestNeighborId(PointView query, bool includeExactMatches) {
+    checkDimensions(query);
+    Node *best = nullptr;
+    double bestDist = numeric_limits<double>::infinity();
+
+    searchNN(query.data(), includeExactMatches, best, bestDist);
+    IdNeighbor neighbor = {best == nullptr ? NO_ID : best->getId(), sqrt(bestDist)};
+    return neighbor;
+}
+
+vector<KDTree::IdNeighbor> KDTree::kNearestIds(PointView query, unsigned int count, bool includeExactMatches) {
+    vector<Neighbor> neighbors;
+    kNearest(query, count, neighbors, includeExactMatches);
+    vector<IdNeighbor> ids;
+    ids.reserve(neighbors.size());
+    for (const Neighbor &neighbor : neighbors) {
+        IdNeighbor id = {neighbor.node->getId(), neighbor.distance};
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+vector<KDTree::IdNeighbor> KDTree::radiusSearchIds(PointView query, double radius) {
+    checkDimensions(query);
+    vector<IdNeighbor> ids;
+    if (radius >= 0) {
+        traverseRadius(query.data(), radius * radius, [&ids](Node *node, double distance) {
+            IdNeighbor id = {node->getId(), sqrt(distance)};
+            ids.push_back(id);
+            return true;
+        });
     }
+    return ids;
+}
 
-    if (k > 1) {
-        double oy = pointOfOrigin[1];
-        b.minY = oy;
-        b.maxY = oy + height;
+vector<size_t> KDTree::rangeSearchIds(PointView minCorner, PointView maxCorner) {
+    if (minCorner.size() != k || maxCorner.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in range. Both corners must have the dimensions of the tree.");
     }
-    
-    if (k > 2) {
-        double oz = pointOfOrigin[2];
-        b.minZ = oz;
-        b.maxZ = oz + length;
+    vector<size_t> ids;
+    traverseRange(minCorner.data(), maxCorner.data(), [&ids](Node *node) {
+        ids.push_back(node->getId());
+        return true;
+    });
+    return ids;
+}
+
+KDTree::Bounds KDTree::makeRange(vector<double> pointOfOrigin, double width, double height, double length) {
+    Bounds b;
+    b.min = vector<double>(k, -numeric_limits<double>::infinity());
+    b.max = vector<double>(k, numeric_limits<double>::infinity());
+    double sizes[] = {width, height, length};
+
+    for (unsigned int i = 0; i < k && i < 3; i++) {
+        b.min[i] = pointOfOrigin[i];
+        b.max[i] = pointOfOrigin[i] + sizes[i];
     }
 
     return b;
@@ -214,24 +1049,392 @@ KDTree::Bounds KDTree::makeRange(vector<double> pointOfOrigin, double width, dou
 vector<Node *> KDTree::rangeSearch(vector<double> pointOfOrigin, double height, double width, double length) {
     vector<Node*> nodesInRange;
     Bounds b = makeRange(pointOfOrigin, height, width, length);
-    recurseGetNodesInRange(root, b, nodesInRange);
+    traverseRange(b.min.data(), b.max.data(), [&nodesInRange](Node *node) {
+        nodesInRange.push_back(node);
+        return true;
+    });
     return nodesInRange;
 }
 
-Node* KDTree::removeNode(vector<double> point) {
-    return recurseRemoveNode(root, point, 0);
+vector<Node *> KDTree::rangeSearch(PointView minCorner, PointView maxCorner) {
+    vector<Node*> nodesInRange;
+    rangeSearch(minCorner, maxCorner, nodesInRange);
+    return nodesInRange;
+}
+
+void KDTree::rangeSearch(PointView minCorner, PointView maxCorner, vector<Node *> &nodesInRange) {
+    if (minCorner.size() != k || maxCorner.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in range. Both corners must have the dimensions of the tree.");
+    }
+    traverseRange(minCorner.data(), maxCorner.data(), [&nodesInRange](Node *node) {
+        nodesInRange.push_back(node);
+        return true;
+    });
+}
+
+bool KDTree::visitRange(PointView minCorner, PointView maxCorner, const function<bool(Node *)> &visitor) {
+    if (minCorner.size() != k || maxCorner.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in range. Both corners must have the dimensions of the tree.");
+    }
+    return traverseRange(minCorner.data(), maxCorner.data(), visitor);
+}
+
+bool KDTree::anyInRange(PointView minCorner, PointView maxCorner) {
+    if (minCorner.size() != k || maxCorner.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in range. Both corners must have the dimensions of the tree.");
+    }
+    return !traverseRange(minCorner.data(), maxCorner.data(), [](Node *) {
+        return false;
+    });
+}
+
+KDTree::RangeCursor KDTree::rangeCursor(PointView minCorner, PointView maxCorner) {
+    if (minCorner.size() != k || maxCorner.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in range. Both corners must have the dimensions of the tree.");
+    }
+    STATS_RESET();
+    return RangeCursor(this, minCorner, maxCorner);
+}
+
+KDTree::RangeCursor::RangeCursor(KDTree *tree, PointView minCorner, PointView maxCorner)
+    : tree(tree), minCorner(minCorner), maxCorner(maxCorner) {
+    descend.node = tree->root;
+    descend.depth = 0;
+    done = false;
+}
+
+Node *KDTree::RangeCursor::next() {
+    // the in-order walk of traverseRange, suspended after each hit
+    while (!done) {
+        while (descend.node != nullptr) {
+            STATS_VISIT(descend.depth);
+            stack.push(descend);
+            unsigned int d = descend.depth % tree->k;
+            if (minCorner[d] < descend.node->getPoint()[d]) {
+                descend.node = descend.node->getLeftNode();
+                descend.depth++;
+            } else {
+                if (descend.node->getLeftNode() != nullptr) {
+                    STATS_PRUNE();
+                }
+                descend.node = nullptr;
+            }
+        }
+        if (stack.empty()) {
+            done = true;
+            break;
+        }
+
+        Frame frame = stack.pop();
+        unsigned int d = frame.depth % tree->k;
+        if (frame.node->getPoint()[d] <= maxCorner[d]) {
+            descend.node = frame.node->getRightNode();
+            descend.depth = frame.depth + 1;
+        } else if (frame.node->getRightNode() != nullptr) {
+            STATS_PRUNE();
+        }
+        if (tree->isInRange(frame.node, minCorner.data(), maxCorner.data())) {
+            return frame.node;
+        }
+    }
+    return nullptr;
+}
+
+void KDTree::RangeCursor::cancel() {
+    done = true;
+}
+
+bool KDTree::RangeCursor::isDone() {
+    return done;
+}
+
+KDTree::RangeCursor::iterator KDTree::RangeCursor::begin() {
+    return iterator(this, next());
+}
+
+KDTree::RangeCursor::iterator KDTree::RangeCursor::end() {
+    return iterator(this, nullptr);
+}
+
+KDTree::RangeCursor::iterator::iterator(RangeCursor *cursor, Node *node) : cursor(cursor), node(node) {}
+
+Node *KDTree::RangeCursor::iterator::operator*() const {
+    return node;
+}
+
+KDTree::RangeCursor::iterator &KDTree::RangeCursor::iterator::operator++() {
+    node = cursor->next();
+    return *this;
+}
+
+bool KDTree::RangeCursor::iterator::operator==(const iterator &other) const {
+    return node == other.node;
+}
+
+bool KDTree::RangeCursor::iterator::operator!=(const iterator &other) const {
+    return node != other.node;
+}
+
+Node* KDTree::removeNode(PointView point) {
+    checkDimensions(point);
+    if (lazyDeletion) {
+        Node *node = findNode(point.data());
+        if (node != nullptr) {
+            node->setDeleted(true);
+            deadCount++;
+            if (deadRatio() > compactionThreshold) {
+                compact();
+            }
+        }
+        return root;
+    }
+
+    removeFromTree(point);
+
+    if (selfBalancing && root != nullptr && root->getSubtreeSize() < alpha * maxNodeCount) {
+        root = rebuildSubtree(root, 0);
+        maxNodeCount = root->getSubtreeSize();
+    }
+    return root;
 }
 
 Node *KDTree::findMinimumAxisValueFromNode(Node *node, unsigned int axis) {
-    return recurseFindMinimum(node == nullptr ? root : node, axis, 0);
+    return findMinimum(node == nullptr ? root : node, axis, 0);
+}
+
+Node* KDTree::insertNode(PointView point) {
+    return insertNode(point, nextId);
+}
+
+Node* KDTree::insertNode(PointView point, size_t id) {
+    checkDimensions(point);
+    if (id == NO_ID) {
+        throw invalid_argument("Incorrect id provided. NO_ID cannot be stored.");
+    }
+    Node *inserted = pool.allocate(point);
+    inserted->setId(id);
+    nextId = max(nextId, id + 1);
+    if (root == nullptr) {
+        root = inserted;
+    } else {
+        // every node on the way down gains the new node in its subtree
+        Node *node = root;
+        unsigned int depth = 0;
+        while (true) {
+            node->setSubtreeSize(node->getSubtreeSize() + 1);
+            unsigned int d = depth % k;
+            bool goLeft = point[d] < node->getPoint()[d];
+            Node *next = goLeft ? node->getLeftNode() : node->getRightNode();
+            if (next == nullptr) {
+                if (goLeft) {
+                    node->setLeftNode(inserted);
+                } else {
+                    node->setRightNode(inserted);
+                }
+                break;
+            }
+            node = next;
+            depth++;
+        }
+    }
+
+    if (selfBalancing) {
+        maxNodeCount = max(maxNodeCount, (size_t)root->getSubtreeSize());
+        rebalanceAfterInsert(point);
+    }
+    return root;
 }
 
-Node* KDTree::insertNode(vector<double> point) {
-    return recurseInsertion(root, point, 0);
+Node *KDTree::build(const vector<vector<double>> &points, unsigned int threadCount) {
+    for (const vector<double> &point : points) {
+        if (point.size() != k) {
+            throw invalid_argument("Incorrect number of dimensions in point. Every point must have the dimensions of the tree.");
+        }
+    }
+
+    clear();
+    pool.reserve(points.size());
+
+    vector<Node *> nodes;
+    nodes.reserve(points.size());
+    for (const vector<double> &point : points) {
+        nodes.push_back(pool.allocate(point));
+        nodes.back()->setId(nodes.size() - 1);
+    }
+    nextId = points.size();
+
+    // every parallel level doubles the number of subtrees built at once
+    unsigned int parallelLevels = 0;
+    for (unsigned int threads = resolveThreadCount(threadCount); threads > 1; threads = (threads + 1) / 2) {
+        parallelLevels++;
+    }
+    root = recurseBuild(nodes, 0, nodes.size(), 0, parallelLevels);
+    maxNodeCount = points.size();
+    deadCount = 0;
+    return root;
 }
 
-Node* KDTree::getNode(vector<double> point) {
-    return recurseGetNode(root, point, 0);
+void KDTree::clear() {
+    pool.clear();
+    root = nullptr;
+    maxNodeCount = 0;
+    deadCount = 0;
+    nextId = 0;
+}
+
+void KDTree::reserve(size_t n) {
+    pool.reserve(n);
+}
+
+size_t KDTree::memoryBytes() {
+    return pool.memoryBytes();
+}
+
+KDTree::QueryStats KDTree::lastQueryStats() {
+#ifdef KDTREE_STATS
+    return queryStats;
+#else
+    return QueryStats();
+#endif
+}
+
+bool KDTree::queryStatsEnabled() {
+#ifdef KDTREE_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+KDTree::TreeStats KDTree::treeStats() {
+    TreeStats stats;
+    BalanceReport report = balanceReport();
+    stats.size = report.nodeCount;
+    stats.height = report.height;
+    stats.optimalHeight = report.optimalHeight;
+    stats.averageDepth = report.averageDepth;
+    stats.depthHistogram.assign(report.height, 0);
+    stats.deadNodes = deadCount;
+    stats.memoryBytes = memoryBytes();
+
+    TraversalStack<Branch> stack;
+    if (root != nullptr) {
+        stack.push(makeBranch(root, 0, 0.0));
+    }
+    while (!stack.empty()) {
+        Branch branch = stack.pop();
+        stats.depthHistogram[branch.depth]++;
+        if (branch.node->getRightNode() != nullptr) {
+            stack.push(makeBranch(branch.node->getRightNode(), branch.depth + 1, 0.0));
+        }
+        if (branch.node->getLeftNode() != nullptr) {
+            stack.push(makeBranch(branch.node->getLeftNode(), branch.depth + 1, 0.0));
+        }
+    }
+    return stats;
+}
+
+KDTree::BalanceReport KDTree::balanceReport() {
+    BalanceReport report;
+    report.nodeCount = 0;
+    report.height = 0;
+    report.optimalHeight = 0;
+    report.minLeafDepth = 0;
+    report.averageDepth = 0.0;
+    if (root == nullptr) {
+        return report;
+    }
+
+    double depthSum = 0.0;
+    report.minLeafDepth = UINT_MAX;
+    TraversalStack<Branch> stack;
+    stack.push(makeBranch(root, 0, 0.0));
+    while (!stack.empty()) {
+        Branch branch = stack.pop();
+        Node *node = branch.node;
+        unsigned int depth = branch.depth;
+
+        report.nodeCount++;
+        depthSum += depth;
+        if (depth + 1 > report.height) {
+            report.height = depth + 1;
+        }
+        if (node->isLeaf() && depth < report.minLeafDepth) {
+            report.minLeafDepth = depth;
+        }
+
+        if (node->getRightNode() != nullptr) {
+            stack.push(makeBranch(node->getRightNode(), depth + 1, 0.0));
+        }
+        if (node->getLeftNode() != nullptr) {
+            stack.push(makeBranch(node->getLeftNode(), depth + 1, 0.0));
+        }
+    }
+    report.averageDepth = depthSum / report.nodeCount;
+
+    // a perfectly balanced binary tree of n nodes has floor(log2(n)) + 1 levels
+    for (size_t n = report.nodeCount; n > 0; n >>= 1) {
+        report.optimalHeight++;
+    }
+    return report;
+}
+
+Node* KDTree::getNode(PointView point) {
+    if (point.size() != k) {
+        return nullptr;
+    }
+    return findNode(point.data());
+}
+
+size_t KDTree::getNodeId(PointView point) {
+    Node *node = getNode(point);
+    return node == nullptr ? NO_ID : node->getId();
+}
+
+void KDTree::checkDimensions(PointView point) {
+    if (point.size() != k) {
+        throw invalid_argument("Incorrect number of dimensions in point. Every point must have the dimensions of the tree.");
+    }
+}
+
+void KDTree::batchGetNode(const double *queries, size_t queryCount, Node **results, unsigned int threadCount) {
+    unsigned int dims = k;
+    parallelFor(queryCount, threadCount, [this, queries, results, dims](size_t i) {
+        results[i] = getNode(PointView(queries + i * dims, dims));
+    });
+}
+
+void KDTree::batchNearestNeighbor(const double *queries, size_t queryCount, Node **results, unsigned int threadCount) {
+    unsigned int dims = k;
+    parallelFor(queryCount, threadCount, [this, queries, results, dims](size_t i) {
+        results[i] = nearestNeighborSearch(PointView(queries + i * dims, dims));
+    });
+}
+
+void KDTree::batchKNearest(const double *queries, size_t queryCount, unsigned int count, Neighbor *results, unsigned int threadCount) {
+    unsigned int dims = k;
+    parallelFor(queryCount, threadCount, [this, queries, count, results, dims](size_t i) {
+        // one buffer per thread, reused by every query that thread runs
+        static thread_local vector<Neighbor> nearest;
+        kNearest(PointView(queries + i * dims, dims), count, nearest);
+        Neighbor *out = results + i * count;
+        for (unsigned int j = 0; j < count; j++) {
+            if (j < nearest.size()) {
+                out[j] = nearest[j];
+            } else {
+                out[j].node = nullptr;
+                out[j].distance = numeric_limits<double>::infinity();
+            }
+        }
+    });
+}
+
+void KDTree::batchRangeSearch(const double *minCorners, const double *maxCorners, size_t queryCount, vector<Node *> *results, unsigned int threadCount) {
+    unsigned int dims = k;
+    parallelFor(queryCount, threadCount, [this, minCorners, maxCorners, results, dims](size_t i) {
+        results[i].clear();
+        rangeSearch(PointView(minCorners + i * dims, dims), PointView(maxCorners + i * dims, dims), results[i]);
+    });
 }
 
 Node* KDTree::getRoot() {
@@ -256,29 +1459,42 @@ void KDTree::printPoint(Node* node) {
     }
 }
 
+/**
+ * PrintFrame struct is a line waiting to be printed by printKDTree: a node, or a missing child when node is nullptr
+ */
+struct PrintFrame {
+    Node *node;
+    string prefix;
+    bool isLeft;
+};
+
 void KDTree::printKDTree(Node *node, string prefix = "", bool isLeft = true) {
     if (!node) {
         return;
     }
 
-    cout << prefix;
-    cout << (isLeft ? "├──" : "└──");
-
-    printPoint(node);
+    vector<PrintFrame> stack;
+    PrintFrame first = {node, prefix, isLeft};
+    stack.push_back(first);
+    while (!stack.empty()) {
+        PrintFrame frame = stack.back();
+        stack.pop_back();
 
-    // Extend the prefix for child branches
-    string newPrefix = prefix + (isLeft ? "│   " : "    ");
-    if (node->getLeftNode() || node->getRightNode()) {
-        if (node->getLeftNode()) {
-            printKDTree(node->getLeftNode(), newPrefix, true);
-        } else {
-            cout << newPrefix << "├──(null)\n";
+        cout << frame.prefix;
+        cout << (frame.isLeft ? "├──" : "└──");
+        if (frame.node == nullptr) {
+            cout << "(null)\n";
+            continue;
         }
+        printPoint(frame.node);
 
-        if (node->getRightNode()) {
-            printKDTree(node->getRightNode(), newPrefix, false);
-        } else {
-            cout << newPrefix << "└──(null)\n";
+        // Extend the prefix for child branches, the right child is stacked first so the left one prints first
+        string newPrefix = frame.prefix + (frame.isLeft ? "│   " : "    ");
+        if (frame.node->getLeftNode() || frame.node->getRightNode()) {
+            PrintFrame right = {frame.node->getRightNode(), newPrefix, false};
+            PrintFrame left = {frame.node->getLeftNode(), newPrefix, true};
+            stack.push_back(right);
+            stack.push_back(left);
         }
     }
 }
@@ -2,8 +2,13 @@
 #define KDTREE_H__ //check for dup declarations
 
 #include "./Node.h"
+#include "./NodePool.h"
+#include "./ParallelFor.h"
+#include "./TraversalStack.h"
 #include <vector>
+#include <functional>
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <climits>
 #include <limits>
@@ -21,13 +26,150 @@ public:
      * Must be greater than zero.
      */
     KDTree(unsigned int dimensions);
+
+    /**
+     * @brief Destroys the KDTree and releases every node it allocated at once. Nodes created outside the tree
+     * and attached with setRoot/setLeftNode/setRightNode stay owned by their creator.
+     */
     ~KDTree();
 
     /**
-     * Bounds struct acts as a 2D, 3D container for a plane or cube's min and max x,y,z coordinates 
+     * id returned by the id queries when there is no such point
+     */
+    static const size_t NO_ID = (size_t)-1;
+
+    /**
+     * Bounds struct acts as a k-dimensional container for a box's min and max coordinate on every dimension
      */
     struct Bounds {
-        double minX, minY, minZ, maxX, maxY, maxZ;
+        vector<double> min;
+        vector<double> max;
+    };
+
+    /**
+     * Neighbor struct pairs a node found by a nearest neighbor query with its distance to the query point
+     */
+    struct Neighbor {
+        Node *node;
+        double distance;
+    };
+
+    /**
+     * IdNeighbor struct pairs the id of a point found by a nearest neighbor query with its distance to the
+     * query point. Unlike Neighbor it holds no pointer into the tree, so it stays valid after the tree changes.
+     */
+    struct IdNeighbor {
+        size_t id;
+        double distance;
+    };
+
+    /**
+     * BalanceReport struct describes the shape of the tree: how many nodes it holds, how deep it is and how
+     * far that depth is from the best possible depth for the same number of nodes
+     */
+    struct BalanceReport {
+        size_t nodeCount;
+        unsigned int height;
+        unsigned int optimalHeight;
+        unsigned int minLeafDepth;
+        double averageDepth;
+    };
+
+    /**
+     * QueryStats struct counts the work done by the last query run on the calling thread: nodes visited,
+     * squared distances computed, subtrees entered after the first descent, subtrees skipped by pruning and
+     * the deepest level reached. Only recorded when the library is compiled with KDTREE_STATS.
+     */
+    struct QueryStats {
+        size_t nodesVisited = 0;
+        size_t distanceEvaluations = 0;
+        size_t branchesVisited = 0;
+        size_t branchesPruned = 0;
+        unsigned int maxDepth = 0;
+    };
+
+    /**
+     * TreeStats struct gathers the tree-level figures: size, height against the best possible height, the
+     * number of nodes on every level (depthHistogram[d] for depth d), tombstones awaiting compaction and
+     * the bytes held by the node pool
+     */
+    struct TreeStats {
+        size_t size;
+        unsigned int height;
+        unsigned int optimalHeight;
+        double averageDepth;
+        vector<size_t> depthHistogram;
+        size_t deadNodes;
+        size_t memoryBytes;
+    };
+
+    /**
+     * RangeCursor walks a k-dimensional range query lazily: every call to next() resumes the pruned in-order
+     * traversal where the previous call stopped and returns the next node within the box, so hits can be
+     * processed as they are found without collecting them, in constant memory on a balanced tree. Stopping
+     * early is just not calling next() again (or cancel()). It is also a range, so it works with range-for:
+     * 
+     *     for (Node *node : tree.rangeCursor(minCorner, maxCorner)) { ... }
+     * 
+     * The cursor keeps its own copy of the box. The tree must not be modified while a cursor over it is in use.
+     */
+    class RangeCursor {
+    public:
+        /**
+         * iterator is a single pass input iterator over the remaining hits of its cursor
+         */
+        class iterator {
+        public:
+            iterator(RangeCursor *cursor, Node *node);
+            Node *operator*() const;
+            iterator &operator++();
+            bool operator==(const iterator &other) const;
+            bool operator!=(const iterator &other) const;
+
+        private:
+            RangeCursor *cursor;
+            Node *node;
+        };
+
+        /**
+         * @brief get the next node within the box, in the same order as rangeSearch returns them
+         * 
+         * @return Node* next node within the box or nullptr once every one has been returned
+         */
+        Node *next();
+
+        /**
+         * @brief ends the query: next() returns nullptr from now on
+         */
+        void cancel();
+
+        /**
+         * @brief get whether the query has ended, because every node was returned or it was cancelled
+         */
+        bool isDone();
+
+        /**
+         * @brief iterator starting at the next hit, takes it from the cursor like next()
+         */
+        iterator begin();
+        iterator end();
+
+    private:
+        friend class KDTree;
+        RangeCursor(KDTree *tree, PointView minCorner, PointView maxCorner);
+
+        struct Frame {
+            Node *node;
+            unsigned int depth;
+        };
+
+        KDTree *tree;
+        vector<double> minCorner;
+        vector<double> maxCorner;
+        TraversalStack<Frame> stack;
+        // subtree to walk down the left side of before taking the next node off the stack
+        Frame descend;
+        bool done;
     };
 
     /**
@@ -46,52 +188,284 @@ public:
     int getDimensions();
 
     /**
-     * @brief inserts a node into the KDTree. The node is inserted recursively through recurseInsertion.
+     * @brief inserts a node into the KDTree. The node is inserted by walking down from the root in a loop.
      * When traversing the tree a node will be inserted on the left or right of a node given it is less than or
      * greater than the dimension of the depth of the tree. 
      * 
-     * @param point (vector<double>) point to insert into the kdtree
-     * @return Node* root of the kdtree 
+     * @param point (PointView) point to insert into the kdtree, copied once into the new node's pool slot
+     * @return Node* root of the kdtree, also stored as the tree's root
+     */
+    Node *insertNode(PointView point);
+
+    /**
+     * @brief inserts a point carrying a user id, returned by the id queries instead of a node. insertNode(point)
+     * assigns ids sequentially, continuing after the largest id given so far.
+     * 
+     * @param point (PointView) point to insert into the kdtree
+     * @param id (size_t) id of the point, any value but NO_ID
+     * @return Node* root of the kdtree, also stored as the tree's root
+     */
+    Node *insertNode(PointView point, size_t id);
+
+    /**
+     * @brief builds a balanced KDTree from a set of points, replacing the current contents of the tree (see clear).
+     * At each depth the points are partitioned around the median of that depth's dimension (nth_element, or
+     * quickselect passes around a sampled pivot for large ranges), the median becomes the subtree root and the
+     * two halves are built recursively. Points equal to the median on the split dimension are placed on the right so the tree obeys the same rules as insertNode.
+     * Runs in O(n log n) and produces a tree of O(log n) depth.
+     * With more than one thread, the two halves of each split near the root are built concurrently, and the
+     * median selections of those splits partition their points on all the threads of their subtree; the tree is
+     * the same for any thread count.
+     * 
+     * The point points[i] gets id i, and later insertNode(point) calls continue from points.size().
+     * 
+     * @param points (const vector<vector<double>>&) points to build the kdtree from
+     * @param threadCount (unsigned int) number of threads to use, 0 for one per hardware core
+     * @return Node* root of the kdtree
+     */
+    Node *build(const vector<vector<double>> &points, unsigned int threadCount = 1);
+
+    /**
+     * @brief turns self-balancing on or off. Every node tracks the size of its subtree; when self-balancing
+     * is on, an insertion that lands deeper than log(n) / log(1 / alpha) rebuilds, with median splits, the lowest
+     * subtree on its path whose child holds more than alpha of its nodes, and a removal that brings the tree
+     * under alpha of its largest size since the last full rebuild rebuilds the whole tree (scapegoat tree).
+     * This keeps the depth O(log n) with amortized O(log n) insertions and removals under any insert/remove
+     * sequence, sorted input included. Many points sharing a value on one dimension limit how balanced any tree
+     * can be, since equal values always go right.
+     * 
+     * @param enabled (bool) whether insertNode and removeNode rebalance the tree
+     * @param alpha (double) balance threshold, strictly between 0.5 and 1: lower is more balanced, but rebuilds more
+     */
+    void setSelfBalancing(bool enabled, double alpha = 0.7);
+
+    /**
+     * @brief get whether self-balancing is on
+     */
+    bool isSelfBalancing();
+
+    /**
+     * @brief turns lazy deletion on or off. With lazy deletion on, removeNode only looks the point up and
+     * marks its node as deleted (a tombstone) instead of restructuring the subtree below it. Tombstoned nodes
+     * stay in the tree, and are skipped by every query, until compact() rebuilds the tree from the live nodes,
+     * which removeNode does by itself once the dead ratio goes over compactionThreshold. Turning lazy deletion
+     * off compacts the tree.
+     * 
+     * @param enabled (bool) whether removeNode tombstones nodes
+     * @param compactionThreshold (double) dead ratio, greater than 0 and at most 1, above which removeNode compacts
+     */
+    void setLazyDeletion(bool enabled, double compactionThreshold = 0.25);
+
+    /**
+     * @brief get whether lazy deletion is on
+     */
+    bool isLazyDeletion();
+
+    /**
+     * @brief get the share of nodes in the tree that are tombstoned
+     * 
+     * @return double number of tombstoned nodes over the number of nodes, 0 for an empty tree
+     */
+    double deadRatio();
+
+    /**
+     * @brief rebuilds the tree from its live nodes with median splits and returns the tombstoned nodes to the
+     * pool. Pointers to tombstoned nodes are invalid afterwards.
+     * 
+     * @return Node* root of the compacted kdtree
+     */
+    Node* compact();
+
+    /**
+     * @brief removes every point from the tree. All nodes allocated by the tree are released at once, their
+     * memory is kept and reused by later insertions.
+     */
+    void clear();
+
+    /**
+     * @brief preallocates room for n nodes so inserting up to n points does not allocate
+     * 
+     * @param n (size_t) number of nodes
+     */
+    void reserve(size_t n);
+
+    /**
+     * @brief get the number of bytes held by the tree's node pool
+     */
+    size_t memoryBytes();
+
+    /**
+     * @brief reports the size, height and depth distribution of the tree so its balance can be verified.
+     * A perfectly balanced tree has height == optimalHeight.
+     * 
+     * @return BalanceReport shape of the tree
+     */
+    BalanceReport balanceReport();
+
+    /**
+     * @brief reports the shape and memory use of the tree, including how many nodes sit on every level
+     * 
+     * @return TreeStats tree-level statistics
+     */
+    TreeStats treeStats();
+
+    /**
+     * @brief get the counters of the last query (search, nearest neighbor, k-nearest, radius, range or
+     * approximate search) run on the calling thread. All zeros unless compiled with KDTREE_STATS.
+     * 
+     * @return QueryStats counters of the last query
      */
-    Node *insertNode(vector<double> point);
+    static QueryStats lastQueryStats();
+
+    /**
+     * @brief whether the library was compiled with KDTREE_STATS, i.e. whether lastQueryStats records anything
+     */
+    static bool queryStatsEnabled();
 
     /**
      * @brief removes a node from the KDTree. The node is removed by first identifying the node to remove, then
      * identifying the min value node in the branch and replacing the to remove node with the min node. Then
-     * recurse down the right and left side setting the right node of the replaced node.
+     * continue down that branch to remove the min node the same way, until the node to remove is a leaf.
+     * The left branch is moved to the right when the node has no right branch.
+     * The leaf unlinked at the end goes back to the pool, or, if it was attached with setRoot/setLeftNode/
+     * setRightNode, is only unlinked and still has to be deleted by its creator.
      * 
-     * @param point (vector<double>) point to remove from the kdtree
-     * @return Node* root of the kdtree
+     * @param point (PointView) point to remove from the kdtree
+     * @return Node* root of the kdtree, also stored as the tree's root
      */
-    Node *removeNode(vector<double> point);
+    Node *removeNode(PointView point);
 
     /**
      * @brief get node from kdtree by traversing the tree and comparing the dimension of each level
      * 
-     * @param point (vector<double>) point to find in tree
+     * @param point (PointView) point to find in tree
      * @return Node* found node or nullptr if not found 
      */
-    Node *getNode(vector<double> point);
+    Node *getNode(PointView point);
+
+    /**
+     * @brief getNode returning the id of the found point
+     * 
+     * @param point (PointView) point to find in tree
+     * @return size_t id of the point or NO_ID if not found
+     */
+    size_t getNodeId(PointView point);
+
+    /**
+     * @brief nearestNeighborSearch(PointView) returning the id and distance of the nearest point
+     * 
+     * @param query (PointView) the point that we are determining the nearest neighbor for
+     * @param includeExactMatches (bool) whether a point equal to the query is a valid answer
+     * @return IdNeighbor nearest point, id is NO_ID if there is none
+     */
+    IdNeighbor nearestNeighborId(PointView query, bool includeExactMatches = true);
+
+    /**
+     * @brief kNearest returning ids and distances, sorted from nearest to farthest
+     */
+    vector<IdNeighbor> kNearestIds(PointView query, unsigned int count, bool includeExactMatches = true);
+
+    /**
+     * @brief radiusSearch returning ids and distances, in traversal order
+     */
+    vector<IdNeighbor> radiusSearchIds(PointView query, double radius);
+
+    /**
+     * @brief k-dimensional rangeSearch returning the ids of the points within the box, in the same order
+     */
+    vector<size_t> rangeSearchIds(PointView minCorner, PointView maxCorner);
 
     /**
      * @brief determines the nearest node of a given target. This is done by traversing the kdtree 
-     * finding the target through recursion then moving back up the kdtree as the recursive calls are
-     * removed from the stack. Each time it encounters a node we check the distance from the node
+     * down to the target, leaving the other branch of every node on an explicit stack, then taking the
+     * branches back off the stack from the deepest one up. Each time it encounters a node we check the distance from the node
      * to the target if its the smallest distance we've seen store that. If the node has another branch
      * we also need need to check it in case the closer value is in that branch.
      * 
-     * @param target (Node*) the target node that we are determining the nearest neighbor for
+     * @param target (Node*) the target node that we are determining the nearest neighbor for, points equal
+     * to the target are skipped
      * @return Node* nearest neighbor by distance of the target
      */
     Node *nearestNeighborSearch(Node *target);
 
     /**
-     * @brief find a range of points that are within a specified plane or cube. With a given point of
-     * origin and height, width, and length (can be null) create a 2D plane or 3D. Traverse the entire tree,
-     * as we traverse check if the point is within the plane/cube by comparing the min and max values of the
-     * plane/cube. If the point lies within the object then it is in the range 
+     * @brief determines the nearest node of a query point with the same traversal as nearestNeighborSearch(Node*)
      * 
+     * @param query (PointView) the point that we are determining the nearest neighbor for
+     * @param includeExactMatches (bool) whether a point equal to the query is a valid answer
+     * @return Node* nearest neighbor by distance of the query or nullptr if there is none
+     */
+    Node *nearestNeighborSearch(PointView query, bool includeExactMatches = true);
+
+    /**
+     * @brief determines the count nodes nearest to a query point, sorted from nearest to farthest. Uses the
+     * same traversal as nearestNeighborSearch, but the best candidates are kept in a max-heap bounded to count
+     * entries: once it is full, the farthest candidate is the pruning distance for the other branches and is
+     * replaced whenever a closer node is found.
+     * 
+     * @param query (PointView) point to find the nearest neighbors of
+     * @param count (unsigned int) number of neighbors to return, fewer if the tree holds fewer points
+     * @param includeExactMatches (bool) whether points equal to the query are returned (distance 0)
+     * @return vector<Neighbor> nearest nodes with their euclidean distance, sorted by distance
+     */
+    vector<Neighbor> kNearest(PointView query, unsigned int count, bool includeExactMatches = true);
+
+    /**
+     * @brief kNearest writing into a caller-owned vector, which is cleared first. Reusing the same vector
+     * across queries makes the query allocation free once its capacity reaches count.
+     */
+    void kNearest(PointView query, unsigned int count, vector<Neighbor> &neighbors, bool includeExactMatches = true);
+
+    /**
+     * @brief approximate nearest neighbor search for queries with a latency budget. Branches are explored
+     * best-bin-first: pending branches wait in a min-heap keyed by a lower bound of their distance to the query
+     * (the farthest splitting plane crossed to reach them) and the closest one is explored next. A branch is
+     * skipped when its bound times (1 + epsilon) is not below the best distance, so the answer is at most
+     * (1 + epsilon) times farther than the true nearest neighbor, and the search stops after maxVisits nodes.
+     * With epsilon 0 and no visit limit the answer is exact.
+     * 
+     * @param query (PointView) the point that we are determining the nearest neighbor for
+     * @param epsilon (double) allowed relative error of the returned distance, 0 or more
+     * @param maxVisits (size_t) maximum number of nodes to visit, 0 for no limit
+     * @param includeExactMatches (bool) whether a point equal to the query is a valid answer
+     * @return Neighbor best node found with its distance, node is nullptr if none was found
+     */
+    Neighbor approximateNearestNeighbor(PointView query, double epsilon, size_t maxVisits = 0, bool includeExactMatches = true);
+
+    /**
+     * @brief find all nodes within distance radius of a query point, bounds included. Same pruning as
+     * nearestNeighborSearch with a fixed distance: the other branch is only visited if its splitting plane is
+     * within radius of the query.
      * 
+     * @param query (PointView) center of the ball
+     * @param radius (double) euclidean radius of the ball
+     * @return vector<Neighbor> nodes within the ball with their distance, in traversal order
+     */
+    vector<Neighbor> radiusSearch(PointView query, double radius);
+
+    /**
+     * @brief radiusSearch appending to a caller-owned vector, allocation free when its capacity is enough
+     */
+    void radiusSearch(PointView query, double radius, vector<Neighbor> &neighbors);
+
+    /**
+     * @brief counts the nodes within distance radius of a query point with the radiusSearch traversal,
+     * without materializing any result
+     * 
+     * @param query (PointView) center of the ball
+     * @param radius (double) euclidean radius of the ball
+     * @return size_t number of nodes within the ball
+     */
+    size_t radiusCount(PointView query, double radius);
+
+    /**
+     * @brief find a range of points that are within a specified plane or cube. With a given point of
+     * origin and height, width, and length (can be null) create a 2D plane or 3D cube spanning
+     * [origin[i], origin[i] + size[i]] on the first three axes, unbounded on any further axis. The search
+     * is the same pruned traversal as the k-dimensional box rangeSearch: a subtree is skipped when its
+     * splitting plane lies outside the plane/cube, and every visited point is checked against the min
+     * and max values of the plane/cube.
+     *
      * @param pointOfOrigin (vector<double>) origin of the plane/cube
      * @param height (double) height of the plane/cube
      * @param width (double) width of the plane/cube
@@ -100,6 +474,134 @@ public:
      */
     vector<Node *> rangeSearch(vector<double> pointOfOrigin, double height, double width, double length);
 
+    /**
+     * @brief find all points inside a k-dimensional box given by its minimum and maximum corner, bounds
+     * included. At each depth the splitting plane is compared to the box: the left subtree is only visited if
+     * the box reaches below the node's value and the right subtree only if it reaches the node's value or above,
+     * so a small box touches O(n^(1 - 1/k) + m) nodes instead of the whole tree.
+     * 
+     * @param minCorner (PointView) minimum value of the box on every dimension
+     * @param maxCorner (PointView) maximum value of the box on every dimension
+     * @return vector<Node*> list of nodes within the box, in order of an in-order traversal
+     */
+    vector<Node *> rangeSearch(PointView minCorner, PointView maxCorner);
+
+    /**
+     * @brief k-dimensional rangeSearch appending the nodes within the box to a caller-owned vector. Reusing a
+     * vector with enough capacity makes the query allocation free.
+     */
+    void rangeSearch(PointView minCorner, PointView maxCorner, vector<Node *> &nodesInRange);
+
+    /**
+     * @brief k-dimensional rangeSearch calling visitor with every node within the box, in the same order as
+     * rangeSearch returns them, instead of collecting them. The search stops as soon as visitor returns false.
+     * 
+     * @param minCorner (PointView) minimum value of the box on every dimension
+     * @param maxCorner (PointView) maximum value of the box on every dimension
+     * @param visitor (const function<bool(Node*)>&) called with each node in the box, returns false to stop
+     * @return bool false if the visitor stopped the search, true if every node in the box was visited
+     */
+    bool visitRange(PointView minCorner, PointView maxCorner, const function<bool(Node *)> &visitor);
+
+    /**
+     * @brief whether at least one point lies inside the box, bounds included. Stops at the first one found.
+     * 
+     * @param minCorner (PointView) minimum value of the box on every dimension
+     * @param maxCorner (PointView) maximum value of the box on every dimension
+     * @return bool whether a point is within the box
+     */
+    bool anyInRange(PointView minCorner, PointView maxCorner);
+
+    /**
+     * @brief starts a k-dimensional range query whose hits are produced one at a time by the returned cursor,
+     * see RangeCursor
+     * 
+     * @param minCorner (PointView) minimum value of the box on every dimension
+     * @param maxCorner (PointView) maximum value of the box on every dimension
+     * @return RangeCursor cursor over the nodes within the box
+     */
+    RangeCursor rangeCursor(PointView minCorner, PointView maxCorner);
+
+    /**
+     * @brief radiusSearch calling visitor with every node within the ball and its distance, in the same order
+     * as radiusSearch returns them, instead of collecting them. The search stops as soon as visitor returns false.
+     * 
+     * @param query (PointView) center of the ball
+     * @param radius (double) euclidean radius of the ball
+     * @param visitor (const function<bool(Node*, double)>&) called with each node in the ball and its
+     * distance to the query, returns false to stop
+     * @return bool false if the visitor stopped the search, true if every node in the ball was visited
+     */
+    bool visitRadius(PointView query, double radius, const function<bool(Node *, double)> &visitor);
+
+    /**
+     * @brief distance join: calls visitor with every pair (a, b), a from this tree and b from other, whose
+     * distance is at most epsilon. Both trees are traversed simultaneously: every subtree gets the bounding box
+     * of its points, and a pair of subtrees is only expanded while the two boxes are within epsilon of each
+     * other, splitting the larger subtree into its node's point and its two children. Tombstoned nodes are skipped.
+     * With more than one thread, the first levels of the pair traversal are split into independent tasks shared
+     * between the threads; pairs then come in no particular order and visitor is called concurrently.
+     * 
+     * @param other (KDTree&) tree to join with, must have the same dimensions; can be this tree
+     * @param epsilon (double) largest euclidean distance of a matched pair, bounds included
+     * @param visitor (const function<void(Node*, Node*, double)>&) called with the node from this tree, the node
+     * from other and their distance; must be safe to call concurrently when threadCount is not 1
+     * @param threadCount (unsigned int) number of threads to use, 0 for one per hardware core
+     */
+    void distanceJoin(KDTree &other, double epsilon, const function<void(Node *, Node *, double)> &visitor, unsigned int threadCount = 1);
+
+    /**
+     * Batch queries run many queries over the tree in parallel. Queries only read the tree, so they are
+     * safe to run concurrently as long as no insert, remove, build or setRoot happens at the same time.
+     * Query points are packed one after another, query i starts at queries[i * dimensions], and each query
+     * writes only its own slots of the preallocated output arrays. A threadCount of 0 uses one thread per
+     * hardware core.
+     */
+
+    /**
+     * @brief runs getNode for every query point
+     * 
+     * @param queries (const double*) queryCount packed points
+     * @param queryCount (size_t) number of query points
+     * @param results (Node**) queryCount slots, set to the found node or nullptr
+     * @param threadCount (unsigned int) number of threads to use
+     */
+    void batchGetNode(const double *queries, size_t queryCount, Node **results, unsigned int threadCount);
+
+    /**
+     * @brief runs nearestNeighborSearch(PointView) for every query point, a stored point equal to the query is
+     * a valid answer
+     * 
+     * @param queries (const double*) queryCount packed points
+     * @param queryCount (size_t) number of query points
+     * @param results (Node**) queryCount slots, set to the nearest node or nullptr if the tree is empty
+     * @param threadCount (unsigned int) number of threads to use
+     */
+    void batchNearestNeighbor(const double *queries, size_t queryCount, Node **results, unsigned int threadCount);
+
+    /**
+     * @brief runs kNearest for every query point
+     * 
+     * @param queries (const double*) queryCount packed points
+     * @param queryCount (size_t) number of query points
+     * @param count (unsigned int) number of neighbors per query
+     * @param results (Neighbor*) queryCount * count slots, query i writes results[i * count] onwards sorted by
+     * distance; slots left over when the tree holds fewer than count points are set to {nullptr, infinity}
+     * @param threadCount (unsigned int) number of threads to use
+     */
+    void batchKNearest(const double *queries, size_t queryCount, unsigned int count, Neighbor *results, unsigned int threadCount);
+
+    /**
+     * @brief runs the k-dimensional rangeSearch for every box
+     * 
+     * @param minCorners (const double*) queryCount packed minimum corners
+     * @param maxCorners (const double*) queryCount packed maximum corners
+     * @param queryCount (size_t) number of boxes
+     * @param results (vector<Node*>*) queryCount vectors, each replaced with the nodes within its box
+     * @param threadCount (unsigned int) number of threads to use
+     */
+    void batchRangeSearch(const double *minCorners, const double *maxCorners, size_t queryCount, vector<Node *> *results, unsigned int threadCount);
+
     /**
      * @brief find the node with the minimum value given the dimension/axis specified from the root
      * 
@@ -109,11 +611,11 @@ public:
     Node *findMinimumAxisValueFromNode(Node *node, unsigned int axis);
 
     /**
-     * @brief Recursively prints the KDTree in a structured tree format.
+     * @brief Prints the KDTree in a structured tree format.
      * 
      * This method outputs the tree structure to the console as branches. 
      * Each node is displayed with its point, and child nodes are printed 
-     * recursively with indentation to indicate tree hierarchy.
+     * below it with indentation to indicate tree hierarchy.
      * 
      * @param node poin to the current Node to print. If nullptr, nothing is printed.
      * @param prefix String used for indentation and branch lines (default is empty).
@@ -125,6 +627,14 @@ public:
 private:
     Node *root;
     unsigned int k;
+    NodePool pool;
+    bool selfBalancing;
+    double alpha;
+    size_t maxNodeCount;
+    bool lazyDeletion;
+    double compactionThreshold;
+    size_t deadCount;
+    size_t nextId;
 
     /**
      * @brief determines the distance between two points using squared distance rather than root distance
@@ -134,10 +644,11 @@ private:
      * @param b a point in the kdtree
      * @return double distance between two points
      */ 
-    double squaredDistance(vector<double> a, vector<double> b);
+    double squaredDistance(const double *a, const double *b);
 
     /**
-     * @brief given a pointOfOrigin, create either a plane or cube given the number of coords
+     * @brief given a pointOfOrigin, create either a plane or cube given the number of coords. Dimensions
+     * past the third are left unbounded.
      * 
      * @param pointOfOrigin point of origin for the plane/cube
      * @param width width of the plane/cube
@@ -146,13 +657,21 @@ private:
      * @return Bounds struct mins/max of object
      */
     Bounds makeRange(vector<double> pointOfOrigin, double width, double height, double length);
-    Node *recurseInsertion(Node *node, vector<double> point, unsigned int depth);
-    Node *recurseGetNode(Node *node, vector<double> point, unsigned int depth);
-    Node *recurseFindMinimum(Node *node, unsigned int axis, unsigned int depth);
-    Node *recurseRemoveNode(Node *node, vector<double> point, unsigned int depth);
-    void recurseNN(Node *node, Node *target, Node *&currentBest, double &currentBestDist, unsigned int depth);
-    void recurseGetNodesInRange(Node *node, Bounds b, vector<Node *> &nodesInRange);
-    void addNodeToInRangeList(Node *node, Bounds b, vector<Node *> &nodesInRange);
+    Node *recurseBuild(vector<Node *> &nodes, size_t first, size_t last, unsigned int depth, unsigned int parallelLevels = 0);
+    Node *rebuildSubtree(Node *node, unsigned int depth);
+    void rebalanceAfterInsert(PointView point);
+    unsigned int updateSizes(Node *node);
+    Node *findNode(const double *point);
+    Node *findMinimum(Node *node, unsigned int axis, unsigned int depth);
+    void removeFromTree(PointView point);
+    void searchNN(const double *target, bool includeExactMatches, Node *&currentBest, double &currentBestDist);
+    void searchKNN(const double *query, unsigned int count, bool includeExactMatches, vector<Neighbor> &heap);
+    template <typename Visit>
+    bool traverseRadius(const double *query, double radiusSquared, Visit visit);
+    template <typename Visit>
+    bool traverseRange(const double *minCorner, const double *maxCorner, Visit visit);
+    bool isInRange(Node *node, const double *minCorner, const double *maxCorner);
+    void checkDimensions(PointView point);
     void printPoint(Node *node);
 };
 
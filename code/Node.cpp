@@ -1,19 +1,51 @@
 #include "Node.h"
 
-Node::Node(vector<double>& point) {
-    this->point = point;
+Node::Node(PointView point) {
+    this->dimensions = point.size();
+    this->point = new double[dimensions];
+    copy(point.begin(), point.end(), this->point);
+    pooled = false;
     left = nullptr;
     right = nullptr;
+    subtreeSize = 1;
+    id = 0;
+    deleted = false;
 }
 
-Node::~Node() {}
+Node::Node(double* storage, PointView point) {
+    this->dimensions = point.size();
+    this->point = storage;
+    copy(point.begin(), point.end(), this->point);
+    pooled = true;
+    left = nullptr;
+    right = nullptr;
+    subtreeSize = 1;
+    id = 0;
+    deleted = false;
+}
+
+Node::~Node() {
+    if (!pooled) {
+        delete[] point;
+    }
+}
 
-vector<double> Node::getPoint() {
-    return point;
+PointView Node::getPoint() {
+    return PointView(point, dimensions);
 }
 
-void Node::setPoint(vector<double> point) {
-    this->point = point;
+void Node::setPoint(PointView point) {
+    if (point.size() != dimensions) {
+        if (pooled) {
+            throw invalid_argument("Incorrect number of dimensions in point. A pooled node keeps the dimensions of its tree.");
+        }
+        delete[] this->point;
+        dimensions = point.size();
+        this->point = new double[dimensions];
+    }
+    if (point.data() != this->point) {
+        copy(point.begin(), point.end(), this->point);
+    }
 }
 
 Node* Node::getLeftNode() {
@@ -35,3 +67,31 @@ void Node::setRightNode(Node* right) {
 bool Node::isLeaf() {
     return getLeftNode() == nullptr && getRightNode() == nullptr;
 }
+
+bool Node::isPooled() {
+    return pooled;
+}
+
+void Node::setSubtreeSize(unsigned int subtreeSize) {
+    this->subtreeSize = subtreeSize;
+}
+
+unsigned int Node::getSubtreeSize() {
+    return subtreeSize;
+}
+
+void Node::setDeleted(bool deleted) {
+    this->deleted = deleted;
+}
+
+bool Node::isDeleted() {
+    return deleted;
+}
+
+void Node::setId(size_t id) {
+    this->id = id;
+}
+
+size_t Node::getId() {
+    return id;
+}
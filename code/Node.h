@@ -1,7 +1,10 @@
 #ifndef NODE_H__ 
 #define NODE_H__ //check for dup declarations
 
+#include "./PointView.h"
 #include <vector>
+#include <algorithm>
+#include <stdexcept>
 
 using namespace std;
 
@@ -10,17 +13,34 @@ class Node {
         Node* left;
         Node* right;
         int axis;
-        vector<double> point;
+        unsigned int subtreeSize;
+        size_t id;
+        double* point;
+        unsigned int dimensions;
+        bool pooled;
+        bool deleted;
+
+        friend class NodePool;
+        Node(double* storage, PointView point); //coordinates live in storage owned by a NodePool
     public:
-        Node(vector<double>& point);
+        Node(PointView point);
+        Node(const Node&) = delete;
+        Node& operator=(const Node&) = delete;
         ~Node(); //destructor
         void setLeftNode(Node* left);
         Node* getLeftNode();
         void setRightNode(Node* right);
         Node* getRightNode();
-        void setPoint(vector<double> point);
-        vector<double> getPoint();
+        void setPoint(PointView point);
+        PointView getPoint(); //view of the node's own coordinates, valid until the point changes
         bool isLeaf();
+        void setSubtreeSize(unsigned int subtreeSize);
+        unsigned int getSubtreeSize(); //number of nodes in the subtree rooted at this node
+        void setDeleted(bool deleted);
+        bool isDeleted(); //tombstoned by a lazy removal, skipped by every query
+        void setId(size_t id);
+        size_t getId(); //user id of the point, travels with the point when removal moves it to another node
+        bool isPooled();
 };
 
 #endif
@@ -0,0 +1,105 @@
+#include "NodePool.h"
+#include <new>
+
+NodePool::NodePool(unsigned int dimensions, size_t slabNodes) {
+    this->dimensions = dimensions;
+    this->slabNodes = slabNodes > 0 ? slabNodes : 1;
+    // the coordinates follow the node in its slot, aligned for double
+    size_t nodeSize = (sizeof(Node) + alignof(double) - 1) / alignof(double) * alignof(double);
+    slotSize = nodeSize + dimensions * sizeof(double);
+    currentSlab = 0;
+    nextSlot = 0;
+    freeList = nullptr;
+    freeSlots = 0;
+    liveNodes = 0;
+}
+
+NodePool::~NodePool() {
+    for (Slab &slab : slabs) {
+        delete[] slab.memory;
+    }
+}
+
+void NodePool::addSlab(size_t slots) {
+    Slab slab;
+    slab.memory = new char[slots * slotSize];
+    slab.slots = slots;
+    slabs.push_back(slab);
+}
+
+Node *NodePool::allocate(PointView point) {
+    if (point.size() != dimensions) {
+        throw invalid_argument("Incorrect number of dimensions in point. Every point must have the dimensions of the tree.");
+    }
+
+    char *slot = nullptr;
+    if (freeList != nullptr) {
+        slot = freeList;
+        freeList = *reinterpret_cast<char **>(slot);
+        freeSlots--;
+    } else {
+        while (currentSlab < slabs.size() && nextSlot == slabs[currentSlab].slots) {
+            currentSlab++;
+            nextSlot = 0;
+        }
+        if (currentSlab == slabs.size()) {
+            addSlab(slabNodes);
+        }
+        slot = slabs[currentSlab].memory + nextSlot * slotSize;
+        nextSlot++;
+    }
+
+    liveNodes++;
+    double *storage = reinterpret_cast<double *>(slot + slotSize - dimensions * sizeof(double));
+    return new (slot) Node(storage, point);
+}
+
+void NodePool::release(Node *node) {
+    if (node == nullptr || !node->isPooled()) {
+        return;
+    }
+
+    // a released slot stores the next free slot in its first bytes
+    node->~Node();
+    char *slot = reinterpret_cast<char *>(node);
+    *reinterpret_cast<char **>(slot) = freeList;
+    freeList = slot;
+    freeSlots++;
+    liveNodes--;
+}
+
+void NodePool::reserve(size_t n) {
+    // slabs before the current one are full, everything past the cursor has never been handed out
+    size_t handedOut = nextSlot;
+    for (size_t i = 0; i < currentSlab && i < slabs.size(); i++) {
+        handedOut += slabs[i].slots;
+    }
+    size_t available = freeSlots + (currentSlab < slabs.size() ? capacity() - handedOut : 0);
+    if (n > liveNodes + available) {
+        addSlab(n - liveNodes - available);
+    }
+}
+
+void NodePool::clear() {
+    freeList = nullptr;
+    freeSlots = 0;
+    currentSlab = 0;
+    nextSlot = 0;
+    liveNodes = 0;
+}
+
+size_t NodePool::size() {
+    return liveNodes;
+}
+
+size_t NodePool::capacity() {
+    size_t slots = 0;
+    for (Slab &slab : slabs) {
+        slots += slab.slots;
+    }
+    return slots;
+}
+
+size_t NodePool::memoryBytes() {
+    return capacity() * slotSize;
+}
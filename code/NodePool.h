@@ -0,0 +1,92 @@
+#ifndef NODEPOOL_H__
+#define NODEPOOL_H__ //check for dup declarations
+
+#include "./Node.h"
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * NodePool allocates the nodes of one tree from large slabs instead of one heap allocation per node. Every
+ * slot holds a Node followed by the coordinates of its point, so a node and its point share a cache line
+ * neighbourhood and are allocated together. Released slots are chained into a free list through their own
+ * memory and reused by the next allocation. Pooled nodes own nothing, so clear() ends all of them at once by resetting the slab cursor,
+ * keeping the slabs for reuse, and the destructor frees every slab without visiting nodes.
+ */
+class NodePool {
+public:
+    /**
+     * @brief Constructs an empty pool for nodes of the given number of dimensions.
+     * 
+     * @param dimensions (unsigned int) number of coordinates stored with each node
+     * @param slabNodes (size_t) number of nodes in each slab allocated when the pool runs out of slots
+     */
+    NodePool(unsigned int dimensions, size_t slabNodes = 1024);
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+    ~NodePool();
+
+    /**
+     * @brief allocates a node holding a copy of point, reusing a released slot when there is one
+     * 
+     * @param point (PointView) coordinates of the node, must have the pool's dimensions
+     * @return Node* new leaf node
+     */
+    Node *allocate(PointView point);
+
+    /**
+     * @brief gives a node back. A pooled node's slot goes on the free list. A node that was not allocated
+     * by a pool is left alone: it stays owned, and is freed, by whoever created it.
+     * 
+     * @param node (Node*) node to release, must no longer be linked in a tree
+     */
+    void release(Node *node);
+
+    /**
+     * @brief makes sure at least n nodes can be allocated in total without allocating another slab
+     * 
+     * @param n (size_t) number of nodes
+     */
+    void reserve(size_t n);
+
+    /**
+     * @brief releases every node of the pool at once. Slabs are kept and reused by later allocations.
+     */
+    void clear();
+
+    /**
+     * @brief get the number of nodes currently allocated and not released
+     */
+    size_t size();
+
+    /**
+     * @brief get the number of nodes the allocated slabs can hold
+     */
+    size_t capacity();
+
+    /**
+     * @brief get the number of bytes held by the slabs
+     */
+    size_t memoryBytes();
+
+private:
+    struct Slab {
+        char *memory;
+        size_t slots;
+    };
+
+    unsigned int dimensions;
+    size_t slotSize;
+    size_t slabNodes;
+    vector<Slab> slabs;
+    size_t currentSlab;
+    size_t nextSlot;
+    char *freeList;
+    size_t freeSlots;
+    size_t liveNodes;
+
+    void addSlab(size_t slots);
+};
+
+#endif
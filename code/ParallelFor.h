@@ -0,0 +1,87 @@
+#ifndef PARALLELFOR_H__
+#define PARALLELFOR_H__ //check for dup declarations
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief resolves a requested thread count: 0 means one thread per hardware core
+ */
+inline unsigned int resolveThreadCount(unsigned int threadCount) {
+    if (threadCount == 0) {
+        threadCount = thread::hardware_concurrency();
+    }
+    return threadCount == 0 ? 1 : threadCount;
+}
+
+/**
+ * @brief calls body(i) for every i in [0, count) on up to threadCount threads, the calling thread included.
+ * Indices are handed out in chunks of chunkSize from a shared atomic counter, so a thread that finishes its
+ * chunk early takes the next one instead of idling while slower threads work through a fixed share.
+ * The first exception thrown by body is rethrown on the calling thread once every thread has stopped.
+ * 
+ * @param count (size_t) number of indices to process
+ * @param threadCount (unsigned int) number of threads to use, 0 for one per hardware core
+ * @param body (Body) callable taking a size_t index, must be safe to call concurrently
+ * @param chunkSize (size_t) number of consecutive indices a thread takes at once
+ */
+template <typename Body>
+void parallelFor(size_t count, unsigned int threadCount, Body body, size_t chunkSize = 64) {
+    if (chunkSize == 0) {
+        chunkSize = 1;
+    }
+    threadCount = resolveThreadCount(threadCount);
+    size_t chunks = (count + chunkSize - 1) / chunkSize;
+    if (threadCount > chunks) {
+        threadCount = (unsigned int)chunks;
+    }
+
+    if (threadCount <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    atomic<size_t> next(0);
+    exception_ptr error;
+    mutex errorMutex;
+
+    auto worker = [&]() {
+        try {
+            for (size_t first = next.fetch_add(chunkSize); first < count; first = next.fetch_add(chunkSize)) {
+                size_t last = first + chunkSize < count ? first + chunkSize : count;
+                for (size_t i = first; i < last; i++) {
+                    body(i);
+                }
+            }
+        } catch (...) {
+            lock_guard<mutex> lock(errorMutex);
+            if (!error) {
+                error = current_exception();
+            }
+            next.store(count);
+        }
+    };
+
+    vector<thread> threads;
+    threads.reserve(threadCount - 1);
+    for (unsigned int t = 1; t < threadCount; t++) {
+        threads.push_back(thread(worker));
+    }
+    worker();
+    for (thread &t : threads) {
+        t.join();
+    }
+
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef POINTVIEW_H__
+#define POINTVIEW_H__ //check for dup declarations
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * PointView is a read-only view of a point's coordinates: a pointer and a number of dimensions, with no
+ * ownership and no copy. Nodes hand out their coordinates as a PointView, and queries take one, so a
+ * vector<double> and a pointer + length into a packed buffer can both be passed without allocating.
+ * A view is only valid while the coordinates it points to are alive and unchanged.
+ */
+class PointView {
+    private:
+        const double* values;
+        size_t dimensions;
+    public:
+        PointView(const vector<double>& point) : values(point.data()), dimensions(point.size()) {}
+        PointView(const double* values, size_t dimensions) : values(values), dimensions(dimensions) {}
+
+        const double* data() const { return values; }
+        size_t size() const { return dimensions; }
+        const double* begin() const { return values; }
+        const double* end() const { return values + dimensions; }
+        double operator[](size_t i) const { return values[i]; }
+
+        /**
+         * @brief copies the coordinates into a vector, for callers that need to keep the point
+         */
+        operator vector<double>() const { return vector<double>(begin(), end()); }
+
+        bool operator==(const PointView& other) const {
+            return dimensions == other.dimensions && equal(begin(), end(), other.begin());
+        }
+        bool operator!=(const PointView& other) const { return !(*this == other); }
+        bool operator==(const vector<double>& other) const { return *this == PointView(other); }
+        bool operator!=(const vector<double>& other) const { return !(*this == PointView(other)); }
+};
+
+inline bool operator==(const vector<double>& a, const PointView& b) { return b == a; }
+inline bool operator!=(const vector<double>& a, const PointView& b) { return b != a; }
+
+#endif
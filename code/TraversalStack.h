@@ -0,0 +1,50 @@
+#ifndef TRAVERSALSTACK_H__
+#define TRAVERSALSTACK_H__ //check for dup declarations
+
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * TraversalStack is the explicit stack of an iterative tree traversal. The first INLINE_FRAMES frames live
+ * inside the object, so a traversal of a balanced tree keeps its stack on the caller's stack and allocates
+ * nothing; a deeper traversal, such as one through a degenerate tree built from sorted input, spills the
+ * extra frames into a vector instead of overflowing the call stack.
+ */
+template <typename Frame>
+class TraversalStack {
+public:
+    TraversalStack() : count(0) {}
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    void push(const Frame &frame) {
+        if (count < INLINE_FRAMES) {
+            inlineFrames[count] = frame;
+        } else {
+            spilledFrames.push_back(frame);
+        }
+        count++;
+    }
+
+    Frame pop() {
+        count--;
+        if (count < INLINE_FRAMES) {
+            return inlineFrames[count];
+        }
+        Frame frame = spilledFrames.back();
+        spilledFrames.pop_back();
+        return frame;
+    }
+
+private:
+    static const size_t INLINE_FRAMES = 128;
+    Frame inlineFrames[INLINE_FRAMES];
+    vector<Frame> spilledFrames;
+    size_t count;
+};
+
+#endif
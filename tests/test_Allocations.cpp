@@ -0,0 +1,243 @@
+// Chekout TEST_F functions bellow to learn what is being tested.
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "../code/KDTree.h"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+// every heap allocation of the test binary goes through these replacements, counted while enabled. Every
+// form of operator new and delete is replaced, nothrow and aligned ones included, so whatever pair the
+// library picks (get_temporary_buffer allocates with nothrow new, for one) allocates and frees through the
+// same malloc/free, as sanitizers checking alloc-dealloc pairs expect.
+static atomic<bool> countingAllocations(false);
+static atomic<size_t> allocationCount(0);
+
+static void *countedMalloc(size_t size) {
+    if (countingAllocations) {
+        allocationCount++;
+    }
+    return malloc(size == 0 ? 1 : size);
+}
+
+void *operator new(size_t size) {
+    void *memory = countedMalloc(size);
+    if (memory == nullptr) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const nothrow_t &) noexcept {
+    return countedMalloc(size);
+}
+
+void *operator new[](size_t size, const nothrow_t &) noexcept {
+    return countedMalloc(size);
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, const nothrow_t &) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, const nothrow_t &) noexcept {
+    free(memory);
+}
+
+#if defined(__cpp_aligned_new)
+static void *countedAlignedMalloc(size_t size, align_val_t alignment) {
+    if (countingAllocations) {
+        allocationCount++;
+    }
+    // aligned_alloc wants a size that is a nonzero multiple of the alignment
+    size_t align = static_cast<size_t>(alignment);
+    size_t rounded = size == 0 ? align : (size + align - 1) / align * align;
+    return aligned_alloc(align, rounded);
+}
+
+void *operator new(size_t size, align_val_t alignment) {
+    void *memory = countedAlignedMalloc(size, alignment);
+    if (memory == nullptr) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](size_t size, align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void *operator new(size_t size, align_val_t alignment, const nothrow_t &) noexcept {
+    return countedAlignedMalloc(size, alignment);
+}
+
+void *operator new[](size_t size, align_val_t alignment, const nothrow_t &) noexcept {
+    return countedAlignedMalloc(size, alignment);
+}
+
+void operator delete(void *memory, align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t, align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t, align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, align_val_t, const nothrow_t &) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, align_val_t, const nothrow_t &) noexcept {
+    free(memory);
+}
+#endif
+
+class test_Allocations : public ::testing::Test {
+    protected:
+        // This function runs only once before any TEST_F function
+        static void SetUpTestCase() {}
+        // This function runs after all TEST_F functions have been executed
+        static void TearDownTestCase() {}
+        // this function runs before every TEST_F function
+        void SetUp() override {
+            countingAllocations = false;
+            allocationCount = 0;
+        }
+        void TearDown() override {
+            countingAllocations = false;
+        }
+
+        void startCounting() {
+            allocationCount = 0;
+            countingAllocations = true;
+        }
+
+        size_t stopCounting() {
+            countingAllocations = false;
+            return allocationCount;
+        }
+};
+
+KDTree *buildAllocationTestTree() {
+    vector<vector<double>> points = vector<vector<double>>();
+    for (int i = 0; i < 1000; i++) {
+        points.push_back(vector<double>{(double)(i * 37 % 101), (double)(i * 53 % 97), (double)(i % 11)});
+    }
+    KDTree *kdTree = new KDTree(3);
+    kdTree->build(points);
+    return kdTree;
+}
+
+TEST_F(test_Allocations, KDTree_GetNodeDoesNotAllocate)
+{
+    {
+        KDTree *kdTree = buildAllocationTestTree();
+        vector<double> present = vector<double>{37.0, 53.0, 1.0};
+        vector<double> missing = vector<double>{200.0, 1.0, 1.0};
+        double packed[] = {74.0, 9.0, 2.0};
+
+        startCounting();
+        Node *found = kdTree->getNode(present);
+        Node *notFound = kdTree->getNode(missing);
+        Node *foundPacked = kdTree->getNode(PointView(packed, 3));
+        ASSERT_EQ(stopCounting(), 0u);
+
+        ASSERT_TRUE(found != nullptr);
+        ASSERT_TRUE(notFound == nullptr);
+        ASSERT_TRUE(foundPacked != nullptr);
+        delete kdTree;
+    }
+}
+
+TEST_F(test_Allocations, KDTree_NearestNeighborDoesNotAllocate)
+{
+    {
+        KDTree *kdTree = buildAllocationTestTree();
+        Node *target = kdTree->getNode(vector<double>{37.0, 53.0, 1.0});
+        vector<double> query = vector<double>{50.5, 40.5, 5.5};
+        vector<KDTree::Neighbor> neighbors = vector<KDTree::Neighbor>();
+        kdTree->kNearest(query, 8, neighbors);
+
+        startCounting();
+        Node *nearestToNode = kdTree->nearestNeighborSearch(target);
+        Node *nearestToQuery = kdTree->nearestNeighborSearch(query);
+        kdTree->kNearest(query, 8, neighbors);
+        ASSERT_EQ(stopCounting(), 0u);
+
+        ASSERT_TRUE(nearestToNode != nullptr && nearestToNode != target);
+        ASSERT_TRUE(nearestToQuery != nullptr);
+        ASSERT_EQ(neighbors.size(), 8u);
+        delete kdTree;
+    }
+}
+
+TEST_F(test_Allocations, KDTree_RangeSearchDoesNotAllocate)
+{
+    {
+        KDTree *kdTree = buildAllocationTestTree();
+        vector<double> minCorner = vector<double>{10.0, 10.0, 0.0};
+        vector<double> maxCorner = vector<double>{60.0, 60.0, 5.0};
+        vector<Node*> nodesInRange = vector<Node*>();
+        nodesInRange.reserve(1000);
+
+        startCounting();
+        kdTree->rangeSearch(minCorner, maxCorner, nodesInRange);
+        ASSERT_EQ(stopCounting(), 0u);
+
+        ASSERT_TRUE(nodesInRange.size() > 0);
+
+        // the overload returning a new vector does allocate, which also checks the counter works
+        startCounting();
+        vector<Node*> returned = kdTree->rangeSearch(minCorner, maxCorner);
+        ASSERT_TRUE(stopCounting() > 0);
+        ASSERT_TRUE(nodesInRange == returned);
+        delete kdTree;
+    }
+}
+
+TEST_F(test_Allocations, KDTree_RadiusCountDoesNotAllocate)
+{
+    {
+        KDTree *kdTree = buildAllocationTestTree();
+        vector<double> query = vector<double>{50.5, 40.5, 5.5};
+
+        startCounting();
+        size_t found = kdTree->radiusCount(query, 20.0);
+        ASSERT_EQ(stopCounting(), 0u);
+
+        ASSERT_EQ(found, kdTree->radiusSearch(query, 20.0).size());
+        delete kdTree;
+    }
+}
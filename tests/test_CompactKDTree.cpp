@@ -0,0 +1,188 @@
+// Chekout TEST_F functions bellow to learn what is being tested.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include "../code/CompactKDTree.h"
+#include "../code/FlatKDTree.h"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+class test_CompactKDTree : public ::testing::Test {
+    protected:
+        // This function runs only once before any TEST_F function
+        static void SetUpTestCase() {}
+        // This function runs after all TEST_F functions have been executed
+        static void TearDownTestCase() {}
+        // this function runs before every TEST_F function
+        void SetUp() override {}
+        void TearDown() override {}
+};
+
+// fractional coordinates, so that float and fixed-point storage actually round them
+vector<double> generatePackedPoints(int numPoints, unsigned int dimensions)
+{
+    srand(42);
+
+    vector<double> coordinates = vector<double>();
+    for (int i = 0; i < numPoints * (int)dimensions; i++) {
+        coordinates.push_back(-50.0 + 100.0 * rand() / (double)RAND_MAX);
+    }
+    return coordinates;
+}
+
+double packedSquaredDistance(const double *a, const vector<double> &b)
+{
+    double distance = 0.0;
+    for (size_t i = 0; i < b.size(); i++) {
+        distance += (a[i] - b[i]) * (a[i] - b[i]);
+    }
+    return distance;
+}
+
+TEST_F(test_CompactKDTree, CompactKDTree_Float32)
+{
+    {
+        const unsigned int k = 3;
+        const int count = 3000;
+        vector<double> coordinates = generatePackedPoints(count, k);
+        CompactKDTree<float> tree(k, coordinates.data(), count);
+        FlatKDTree flat(k, coordinates.data(), count);
+
+        ASSERT_EQ(tree.size(), (size_t)count);
+        ASSERT_EQ(tree.getDimensions(), (int)k);
+        ASSERT_TRUE(tree.memoryBytes() < flat.memoryBytes());
+        ASSERT_EQ(tree.getScale(0), 1.0);
+        ASSERT_EQ(tree.getOffset(0), 0.0);
+        ASSERT_TRUE(tree.maxError(0) > 0.0 && tree.maxError(0) < 1e-5);
+
+        for (int id = 0; id < count; id += 97) {
+            vector<double> point(coordinates.begin() + id * k, coordinates.begin() + (id + 1) * k);
+            int found = tree.getNode(point);
+            ASSERT_NE(found, CompactKDTree<float>::NONE);
+            for (unsigned int d = 0; d < k; d++) {
+                ASSERT_EQ((float)coordinates[found * k + d], (float)point[d]);
+            }
+        }
+
+        for (int q = 0; q < 50; q++) {
+            vector<double> target = {q - 25.0, 13.0 - q / 2.0, q * 0.7};
+            int expected = 0;
+            for (int i = 1; i < count; i++) {
+                if (packedSquaredDistance(&coordinates[i * k], target) < packedSquaredDistance(&coordinates[expected * k], target)) {
+                    expected = i;
+                }
+            }
+            int refined = tree.nearestNeighborSearch(target, coordinates.data());
+            ASSERT_EQ(packedSquaredDistance(&coordinates[refined * k], target), packedSquaredDistance(&coordinates[expected * k], target));
+            int stored = tree.nearestNeighborSearch(target);
+            ASSERT_NEAR(sqrt(packedSquaredDistance(&coordinates[stored * k], target)), sqrt(packedSquaredDistance(&coordinates[expected * k], target)), 1e-4);
+        }
+    }
+}
+
+TEST_F(test_CompactKDTree, CompactKDTree_Quantized)
+{
+    {
+        const unsigned int k = 2;
+        const int count = 4000;
+        vector<double> coordinates = generatePackedPoints(count, k);
+        CompactKDTree<int16_t> tree(k, coordinates.data(), count, 8);
+        CompactKDTree<int32_t> wide(k, coordinates.data(), count, 8);
+        FlatKDTree flat(k, coordinates.data(), count, 8);
+
+        ASSERT_TRUE(tree.memoryBytes() < wide.memoryBytes());
+        ASSERT_TRUE(wide.memoryBytes() < flat.memoryBytes());
+        for (unsigned int d = 0; d < k; d++) {
+            ASSERT_TRUE(tree.maxError(d) <= tree.getScale(d) / 2.0 * (1.0 + 1e-9));
+            ASSERT_TRUE(wide.maxError(d) < tree.maxError(d));
+        }
+
+        vector<double> minCorner = {-20.0, 5.0};
+        vector<double> maxCorner = {10.5, 30.25};
+        vector<int> exact;
+        vector<int> stored;
+        for (int i = 0; i < count; i++) {
+            bool inside = true;
+            bool storedInside = true;
+            for (unsigned int d = 0; d < k; d++) {
+                double value = coordinates[i * k + d];
+                double q = round((value - tree.getOffset(d)) / tree.getScale(d));
+                double decoded = tree.getOffset(d) + tree.getScale(d) * q;
+                inside = inside && minCorner[d] <= value && value <= maxCorner[d];
+                storedInside = storedInside && minCorner[d] <= decoded && decoded <= maxCorner[d];
+            }
+            if (inside) {
+                exact.push_back(i);
+            }
+            if (storedInside) {
+                stored.push_back(i);
+            }
+        }
+        vector<int> refinedRange = tree.rangeSearch(minCorner, maxCorner, coordinates.data());
+        vector<int> storedRange = tree.rangeSearch(minCorner, maxCorner);
+        sort(refinedRange.begin(), refinedRange.end());
+        sort(storedRange.begin(), storedRange.end());
+        ASSERT_TRUE(exact.size() > 100);
+        ASSERT_TRUE(refinedRange == exact);
+        ASSERT_TRUE(storedRange == stored);
+
+        for (int q = 0; q < 50; q++) {
+            vector<double> target = {q * 1.9 - 45.0, 40.0 - q * 1.3};
+            int expected = 0;
+            for (int i = 1; i < count; i++) {
+                if (packedSquaredDistance(&coordinates[i * k], target) < packedSquaredDistance(&coordinates[expected * k], target)) {
+                    expected = i;
+                }
+            }
+            int refined = tree.nearestNeighborSearch(target, coordinates.data());
+            ASSERT_EQ(packedSquaredDistance(&coordinates[refined * k], target), packedSquaredDistance(&coordinates[expected * k], target));
+        }
+
+        ASSERT_NE(tree.nearestNeighborSearch(vector<double>{1e6, -1e6}), CompactKDTree<int16_t>::NONE);
+        ASSERT_THROW(tree.nearestNeighborSearch(vector<double>{1.0}), invalid_argument);
+        ASSERT_THROW(CompactKDTree<int16_t>(0, coordinates.data(), count), invalid_argument);
+    }
+}
+
+TEST_F(test_CompactKDTree, CompactKDTree_QuantizationCollisions)
+{
+    {
+        // points 1e-9 apart inside a box of +-1e6 all quantize to the same stored point: more than a leaf holds
+        const unsigned int k = 2;
+        const int colliding = 600;
+        vector<double> coordinates = vector<double>();
+        for (int i = 0; i < colliding; i++) {
+            coordinates.push_back(0.0);
+            coordinates.push_back(1e-9 * i);
+        }
+        double corners[4][2] = {{-1e6, -1e6}, {-1e6, 1e6}, {1e6, -1e6}, {1e6, 1e6}};
+        for (auto &corner : corners) {
+            coordinates.push_back(corner[0]);
+            coordinates.push_back(corner[1]);
+        }
+        const int count = colliding + 4;
+        CompactKDTree<int16_t> tree(k, coordinates.data(), count, 8);
+        ASSERT_EQ(tree.size(), (size_t)count);
+
+        ASSERT_LT(tree.getNode(vector<double>{0.0, 3e-7}), colliding);
+        ASSERT_LT(tree.nearestNeighborSearch(vector<double>{1.0, 1.0}), colliding);
+        ASSERT_EQ(tree.rangeSearch(vector<double>{-1.0, -1.0}, vector<double>{1.0, 1.0}).size(), (size_t)colliding);
+
+        // at full precision the colliding points are told apart again
+        vector<double> target = {0.0, 1e-9 * 417.2};
+        ASSERT_EQ(tree.nearestNeighborSearch(target, coordinates.data()), 417);
+        vector<double> minCorner = {0.0, 1e-9 * 99.5};
+        vector<double> maxCorner = {0.0, 1e-9 * 200.5};
+        vector<int> refinedRange = tree.rangeSearch(minCorner, maxCorner, coordinates.data());
+        sort(refinedRange.begin(), refinedRange.end());
+        ASSERT_EQ(refinedRange.size(), 101u);
+        ASSERT_EQ(refinedRange.front(), 100);
+        ASSERT_EQ(refinedRange.back(), 200);
+    }
+}
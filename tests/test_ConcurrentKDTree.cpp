@@ -0,0 +1,201 @@
+// Chekout TEST_F functions bellow to learn what is being tested.
+#include <atomic>
+#include <cstdlib>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+#include "../code/ConcurrentKDTree.h"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+class test_ConcurrentKDTree : public ::testing::Test {
+    protected:
+        // This function runs only once before any TEST_F function
+        static void SetUpTestCase() {}
+        // This function runs after all TEST_F functions have been executed
+        static void TearDownTestCase() {}
+        // this function runs before every TEST_F function
+        void SetUp() override {}
+        void TearDown() override {}
+};
+
+TEST_F(test_ConcurrentKDTree, ConcurrentKDTree_SnapshotsAreImmutable)
+{
+    {
+        ConcurrentKDTree *tree = new ConcurrentKDTree(2);
+        tree->build(vector<vector<double>>{{5.0, 5.0}, {2.0, 8.0}, {8.0, 1.0}, {1.0, 1.0}, {9.0, 9.0}});
+        shared_ptr<const ConcurrentKDTree::Snapshot> before = tree->snapshot();
+
+        tree->insertNode(vector<double>{3.0, 3.0});
+        ASSERT_TRUE(tree->removeNode(vector<double>{5.0, 5.0}));
+        ASSERT_FALSE(tree->removeNode(vector<double>{4.0, 4.0}));
+        shared_ptr<const ConcurrentKDTree::Snapshot> after = tree->snapshot();
+
+        // the old version still holds exactly what it held when it was taken
+        ASSERT_EQ(before->size(), 5u);
+        ASSERT_TRUE(before->getNode(vector<double>{5.0, 5.0}) != nullptr);
+        ASSERT_TRUE(before->getNode(vector<double>{3.0, 3.0}) == nullptr);
+        ASSERT_TRUE((before->nearestNeighborSearch(vector<double>{3.1, 3.1})->getPoint() == vector<double>{5.0, 5.0}));
+
+        ASSERT_EQ(after->size(), 5u);
+        ASSERT_TRUE(after->getNode(vector<double>{5.0, 5.0}) == nullptr);
+        ASSERT_TRUE(after->getNode(vector<double>{3.0, 3.0}) != nullptr);
+        ASSERT_TRUE((after->nearestNeighborSearch(vector<double>{3.1, 3.1})->getPoint() == vector<double>{3.0, 3.0}));
+        ASSERT_EQ(after->rangeSearch(vector<double>{0.0, 0.0}, vector<double>{10.0, 10.0}).size(), 5u);
+
+        vector<ConcurrentKDTree::Neighbor> neighbors = after->kNearest(vector<double>{0.0, 0.0}, 2);
+        ASSERT_EQ(neighbors.size(), 2u);
+        ASSERT_TRUE((neighbors[0].node->getPoint() == vector<double>{1.0, 1.0}));
+        ASSERT_TRUE((neighbors[1].node->getPoint() == vector<double>{3.0, 3.0}));
+        delete tree;
+    }
+}
+
+TEST_F(test_ConcurrentKDTree, ConcurrentKDTree_RemoveMatchesContents)
+{
+    {
+        srand(time(0));
+        ConcurrentKDTree *tree = new ConcurrentKDTree(3);
+        vector<vector<double>> points;
+        for (int i = 0; i < 500; i++) {
+            points.push_back(vector<double>{(double)(rand() % 20), (double)(rand() % 20), (double)(rand() % 20)});
+            tree->insertNode(points.back());
+        }
+        for (size_t i = 0; i < points.size(); i += 2) {
+            ASSERT_TRUE(tree->removeNode(points[i]));
+        }
+
+        shared_ptr<const ConcurrentKDTree::Snapshot> snapshot = tree->snapshot();
+        ASSERT_EQ(snapshot->size(), points.size() / 2);
+        ASSERT_EQ(snapshot->rangeSearch(vector<double>{0.0, 0.0, 0.0}, vector<double>{20.0, 20.0, 20.0}).size(), points.size() / 2);
+        for (size_t i = 1; i < points.size(); i += 2) {
+            ASSERT_TRUE(snapshot->getNode(points[i]) != nullptr);
+        }
+        delete tree;
+    }
+}
+
+TEST_F(test_ConcurrentKDTree, ConcurrentKDTree_ReadersDuringWrites)
+{
+    {
+        ConcurrentKDTree *tree = new ConcurrentKDTree(2);
+        atomic<bool> done(false);
+        atomic<int> failures(0);
+
+        // readers check that every snapshot is consistent: its size matches what a full range search finds
+        vector<thread> readers;
+        for (int r = 0; r < 4; r++) {
+            readers.push_back(thread([tree, &done, &failures]() {
+                while (!done.load()) {
+                    shared_ptr<const ConcurrentKDTree::Snapshot> snapshot = tree->snapshot();
+                    size_t found = snapshot->rangeSearch(vector<double>{0.0, 0.0}, vector<double>{1000.0, 1000.0}).size();
+                    if (found != snapshot->size()) {
+                        failures++;
+                    }
+                    snapshot->nearestNeighborSearch(vector<double>{500.0, 500.0});
+                }
+            }));
+        }
+
+        for (int i = 0; i < 2000; i++) {
+            tree->insertNode(vector<double>{(double)((i * 37) % 1000), (double)((i * 91) % 1000)});
+            if (i % 3 == 0) {
+                tree->removeNode(vector<double>{(double)((i * 37) % 1000), (double)((i * 91) % 1000)});
+            }
+        }
+        done = true;
+        for (thread &reader : readers) {
+            reader.join();
+        }
+
+        ASSERT_EQ(failures.load(), 0);
+        ASSERT_EQ(tree->snapshot()->size(), 2000u - 667u);
+        delete tree;
+    }
+}
+
+TEST_F(test_ConcurrentKDTree, ConcurrentKDTree_SnapshotsDuringPublishes)
+{
+    {
+        ConcurrentKDTree *tree = new ConcurrentKDTree(2);
+        atomic<bool> done(false);
+        atomic<int> failures(0);
+
+        // readers only take and drop snapshots, so every publish races with a reader releasing the version it
+        // retires; with inserts only, each reader must see the size never go down
+        vector<thread> readers;
+        for (int r = 0; r < 4; r++) {
+            readers.push_back(thread([tree, &done, &failures]() {
+                size_t lastSize = 0;
+                while (!done.load()) {
+                    size_t size = tree->snapshot()->size();
+                    if (size < lastSize) {
+                        failures++;
+                    }
+                    lastSize = size;
+                }
+            }));
+        }
+
+        vector<thread> writers;
+        for (int w = 0; w < 2; w++) {
+            writers.push_back(thread([tree, w]() {
+                for (int i = 0; i < 200; i++) {
+                    tree->insertNode(vector<double>{(double)w, (double)i});
+                }
+            }));
+        }
+        for (thread &writer : writers) {
+            writer.join();
+        }
+        done = true;
+        for (thread &reader : readers) {
+            reader.join();
+        }
+
+        ASSERT_EQ(failures.load(), 0);
+        ASSERT_EQ(tree->snapshot()->size(), 400u);
+        delete tree;
+    }
+}
+
+TEST_F(test_ConcurrentKDTree, ConcurrentKDTree_DegenerateVersionDoesNotOverflow)
+{
+    {
+        // a chain as deep as sorted inserts build, linked by hand to keep the test fast
+        const int count = 300000;
+        shared_ptr<const ConcurrentKDTree::VersionNode> chain;
+        for (int i = count - 1; i >= 0; i--) {
+            chain = make_shared<ConcurrentKDTree::VersionNode>(vector<double>{(double)i, (double)i}, nullptr, chain);
+        }
+        shared_ptr<const ConcurrentKDTree::Snapshot> snapshot = make_shared<ConcurrentKDTree::Snapshot>(2, chain, count);
+        chain.reset();
+
+        vector<double> last = vector<double>{(double)(count - 1), (double)(count - 1)};
+        ASSERT_TRUE(snapshot->getNode(last) != nullptr);
+        ASSERT_TRUE(snapshot->nearestNeighborSearch(vector<double>{count + 5.0, count + 5.0})->getPoint() == last);
+        ASSERT_TRUE((snapshot->kNearest(last, 2)[1].node->getPoint() == vector<double>{count - 2.0, count - 2.0}));
+        ASSERT_EQ(snapshot->rangeSearch(vector<double>{count - 10.0, 0.0}, last).size(), 10u);
+        // releasing the last holder frees the whole chain
+        snapshot.reset();
+
+        // sorted inserts and removals from the back walk and copy the full depth of the chain
+        ConcurrentKDTree *tree = new ConcurrentKDTree(2);
+        const int inserts = 1000;
+        for (int i = 0; i < inserts; i++) {
+            tree->insertNode(vector<double>{(double)i, (double)i});
+        }
+        for (int i = inserts - 1; i >= 0; i -= 2) {
+            ASSERT_TRUE(tree->removeNode(vector<double>{(double)i, (double)i}));
+        }
+        snapshot = tree->snapshot();
+        ASSERT_EQ(snapshot->size(), (size_t)inserts / 2);
+        for (int i = 0; i < inserts; i++) {
+            ASSERT_EQ(snapshot->getNode(vector<double>{(double)i, (double)i}) != nullptr, i % 2 == 0);
+        }
+        delete tree;
+    }
+}
@@ -0,0 +1,103 @@
+// Chekout TEST_F functions bellow to learn what is being tested.
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "../code/DynamicKDTree.h"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+class test_DynamicKDTree : public ::testing::Test {
+    protected:
+        // This function runs only once before any TEST_F function
+        static void SetUpTestCase() {}
+        // This function runs after all TEST_F functions have been executed
+        static void TearDownTestCase() {}
+        // this function runs before every TEST_F function
+        void SetUp() override {}
+        void TearDown() override {}
+};
+
+double dynamicSquaredDistance(const double *a, const vector<double> &b)
+{
+    double distance = 0.0;
+    for (size_t i = 0; i < b.size(); i++) {
+        distance += (a[i] - b[i]) * (a[i] - b[i]);
+    }
+    return distance;
+}
+
+TEST_F(test_DynamicKDTree, DynamicKDTree_Constructor)
+{
+    ASSERT_THROW(DynamicKDTree(0), invalid_argument);
+    ASSERT_THROW(DynamicKDTree(2, 0), invalid_argument);
+    ASSERT_THROW(DynamicKDTree(2, 16, 0), invalid_argument);
+
+    DynamicKDTree tree(3);
+    ASSERT_EQ(tree.getDimensions(), 3);
+    ASSERT_EQ(tree.size(), 0u);
+    ASSERT_EQ(tree.nearestNeighborSearch(vector<double>{1.0, 2.0, 3.0}).id, DynamicKDTree::NO_ID);
+    ASSERT_TRUE(tree.rangeSearch(vector<double>{0.0, 0.0, 0.0}, vector<double>{9.0, 9.0, 9.0}).empty());
+    ASSERT_THROW(tree.insert(vector<double>{1.0, 2.0}), invalid_argument);
+}
+
+TEST_F(test_DynamicKDTree, DynamicKDTree_LevelsAndQueries)
+{
+    {
+        const unsigned int k = 2;
+        const size_t bufferSize = 32;
+        DynamicKDTree tree(k, bufferSize, 4);
+
+        // sorted input, the worst case for a single KDTree, and a batch in the middle
+        vector<double> coordinates;
+        for (int i = 0; i < 1000; i++) {
+            coordinates.push_back(i);
+            coordinates.push_back((i * 37) % 1000);
+        }
+        for (size_t i = 0; i < 300; i++) {
+            ASSERT_EQ(tree.insert(PointView(&coordinates[i * k], k)), i);
+        }
+        ASSERT_EQ(tree.insertBatch(&coordinates[300 * k], 700), 300u);
+        ASSERT_EQ(tree.size(), 1000u);
+
+        // 1000 = 31 * 32 + 8: levels hold the binary digits of 31, the buffer the 8 left
+        vector<size_t> levels = tree.levelSizes();
+        ASSERT_EQ(levels.size(), 5u);
+        for (size_t i = 0; i < levels.size(); i++) {
+            ASSERT_EQ(levels[i], bufferSize << i);
+        }
+
+        for (int q = 0; q < 40; q++) {
+            vector<double> query = {q * 25.3, 990.0 - q * 24.1};
+            vector<double> distances;
+            for (size_t i = 0; i < 1000; i++) {
+                distances.push_back(sqrt(dynamicSquaredDistance(&coordinates[i * k], query)));
+            }
+            sort(distances.begin(), distances.end());
+
+            vector<DynamicKDTree::Neighbor> neighbors = tree.kNearest(query, 5);
+            ASSERT_EQ(neighbors.size(), 5u);
+            for (size_t i = 0; i < neighbors.size(); i++) {
+                ASSERT_EQ(neighbors[i].distance, distances[i]);
+                ASSERT_EQ(neighbors[i].distance, sqrt(dynamicSquaredDistance(&coordinates[neighbors[i].id * k], query)));
+            }
+            ASSERT_EQ(tree.nearestNeighborSearch(query).distance, distances[0]);
+        }
+
+        vector<double> minCorner = {100.0, 200.0};
+        vector<double> maxCorner = {995.0, 600.0};
+        vector<size_t> expected;
+        for (size_t i = 0; i < 1000; i++) {
+            if (minCorner[0] <= coordinates[i * k] && coordinates[i * k] <= maxCorner[0]
+                    && minCorner[1] <= coordinates[i * k + 1] && coordinates[i * k + 1] <= maxCorner[1]) {
+                expected.push_back(i);
+            }
+        }
+        vector<size_t> found = tree.rangeSearch(minCorner, maxCorner);
+        sort(found.begin(), found.end());
+        ASSERT_TRUE(found == expected);
+    }
+}
@@ -0,0 +1,138 @@
+// Chekout TEST_F functions bellow to learn what is being tested.
+#include <cstdlib>
+#include <ctime>
+#include <limits>
+#include <vector>
+
+#include "../code/FixedKDTree.h"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+class test_FixedKDTree : public ::testing::Test {
+    protected:
+        // This function runs only once before any TEST_F function
+        static void SetUpTestCase() {}
+        // This function runs after all TEST_F functions have been executed
+        static void TearDownTestCase() {}
+        // this function runs before every TEST_F function
+        void SetUp() override {}
+        void TearDown() override {}
+};
+
+template <unsigned int K, typename Scalar>
+vector<array<Scalar, K>> generateFixedPoints(int numPoints)
+{
+    srand(time(0));
+
+    vector<array<Scalar, K>> points = vector<array<Scalar, K>>();
+    for (int i = 0; i < numPoints; i++) {
+        array<Scalar, K> point;
+        for (unsigned int d = 0; d < K; d++) {
+            point[d] = rand() % 101;
+        }
+        points.push_back(point);
+    }
+    return points;
+}
+
+TEST_F(test_FixedKDTree, FixedKDTree_InsertAndGetNode)
+{
+    {
+        FixedKDTree<2> *tree = new FixedKDTree<2>();
+        vector<array<double, 2>> points = vector<array<double, 2>>{{{8.0, 5.0}}, {{3.0, 6.0}}, {{10.0, 2.0}}};
+        for (auto point : points) {
+            tree->insertNode(point);
+        }
+
+        ASSERT_EQ(tree->size(), 3u);
+        ASSERT_EQ(tree->getDimensions(), 2);
+        for (size_t i = 0; i < points.size(); i++) {
+            ASSERT_EQ(tree->getNode(points[i]), (int)i);
+        }
+        array<double, 2> missing = {{101.0, 200.0}};
+        ASSERT_EQ(tree->getNode(missing), FixedKDTree<2>::NONE);
+    }
+}
+
+TEST_F(test_FixedKDTree, FixedKDTree_BuildMatchesBruteForce3DFloat)
+{
+    {
+        vector<array<float, 3>> points = generateFixedPoints<3, float>(1000);
+        FixedKDTree<3, float> *tree = new FixedKDTree<3, float>();
+        tree->build(points);
+
+        for (size_t i = 0; i < points.size(); i++) {
+            ASSERT_TRUE(tree->getPoint(tree->getNode(points[i])) == points[i]);
+        }
+
+        array<float, 3> query = {{50.5f, 49.5f, 20.25f}};
+        vector<float> distances = vector<float>();
+        for (auto point : points) {
+            float distance = 0;
+            for (unsigned int d = 0; d < 3; d++) {
+                distance += (point[d] - query[d]) * (point[d] - query[d]);
+            }
+            distances.push_back(sqrt(distance));
+        }
+        sort(distances.begin(), distances.end());
+
+        int nearest = tree->nearestNeighborSearch(query);
+        vector<FixedKDTree<3, float>::Neighbor> neighbors = tree->kNearest(query, 8);
+        ASSERT_EQ(neighbors.size(), 8u);
+        ASSERT_TRUE(tree->getPoint(nearest) == tree->getPoint(neighbors[0].node));
+        for (size_t i = 0; i < neighbors.size(); i++) {
+            ASSERT_FLOAT_EQ(neighbors[i].distance, distances[i]);
+        }
+    }
+}
+
+TEST_F(test_FixedKDTree, FixedKDTree_RangeSearchMatchesBruteForce)
+{
+    {
+        vector<array<double, 2>> points = generateFixedPoints<2, double>(1000);
+        FixedKDTree<2> *tree = new FixedKDTree<2>();
+        for (auto point : points) {
+            tree->insertNode(point);
+        }
+
+        array<double, 2> minCorner = {{20.0, 30.0}};
+        array<double, 2> maxCorner = {{45.0, 80.0}};
+        vector<int> expected = vector<int>();
+        for (size_t i = 0; i < points.size(); i++) {
+            if (minCorner[0] <= points[i][0] && points[i][0] <= maxCorner[0] && minCorner[1] <= points[i][1] && points[i][1] <= maxCorner[1]) {
+                expected.push_back(i);
+            }
+        }
+
+        vector<int> nodesInRange = tree->rangeSearch(minCorner, maxCorner);
+        sort(nodesInRange.begin(), nodesInRange.end());
+        ASSERT_TRUE(nodesInRange == expected);
+    }
+}
+
+TEST_F(test_FixedKDTree, FixedKDTree_DegenerateTreeDoesNotOverflow)
+{
+    {
+        // sorted inserts chain every node to the right of the previous one
+        FixedKDTree<2, float> *tree = new FixedKDTree<2, float>();
+        const int count = 10000;
+        for (int i = 0; i < count; i++) {
+            array<float, 2> point = {{(float)i, (float)i}};
+            tree->insertNode(point);
+        }
+
+        array<float, 2> query = {{(float)count - 0.25f, (float)count - 0.25f}};
+        ASSERT_EQ(tree->nearestNeighborSearch(query), count - 1);
+        vector<FixedKDTree<2, float>::Neighbor> neighbors = tree->kNearest(query, 3);
+        ASSERT_EQ(neighbors.size(), 3u);
+        ASSERT_EQ(neighbors[0].node, count - 1);
+        ASSERT_EQ(neighbors[2].node, count - 3);
+
+        array<float, 2> minCorner = {{(float)count - 10, 0.0f}};
+        array<float, 2> maxCorner = {{(float)count, (float)count}};
+        ASSERT_EQ(tree->rangeSearch(minCorner, maxCorner).size(), 10u);
+        delete tree;
+    }
+}
@@ -0,0 +1,438 @@
+// Chekout TEST_F functions bellow to learn what is being tested.
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+#include "../code/FlatKDTree.h"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+class test_FlatKDTree : public ::testing::Test {
+    protected:
+        // This function runs only once before any TEST_F function
+        static void SetUpTestCase() {}
+        // This function runs after all TEST_F functions have been executed
+        static void TearDownTestCase() {}
+        // this function runs before every TEST_F function
+        void SetUp() override {}
+        void TearDown() override {}
+};
+
+vector<vector<double>> generateFlatPoints(int numPoints, unsigned int dimensions)
+{
+    srand(time(0));
+
+    vector<vector<double>> points = vector<vector<double>>();
+    for (int i = 0; i < numPoints; i++) {
+        vector<double> point = vector<double>();
+        for (unsigned int d = 0; d < dimensions; d++) {
+            point.push_back(rand() % 101);
+        }
+        points.push_back(point);
+    }
+    return points;
+}
+
+double bruteForceSquaredDistance(const vector<double> &a, const vector<double> &b)
+{
+    double distance = 0.0;
+    for (size_t i = 0; i < a.size(); i++) {
+        distance += (a[i] - b[i]) * (a[i] - b[i]);
+    }
+    return distance;
+}
+
+TEST_F(test_FlatKDTree, FlatKDTree_Constructor)
+{
+    bool seenError = false;
+    try {
+        new FlatKDTree(0, vector<vector<double>>());
+    } catch (const invalid_argument& e) {
+        seenError = true;
+    }
+    ASSERT_TRUE(seenError);
+
+    seenError = false;
+    try {
+        new FlatKDTree(2, vector<vector<double>>(), 0);
+    } catch (const invalid_argument& e) {
+        seenError = true;
+    }
+    ASSERT_TRUE(seenError);
+
+    FlatKDTree *flatTree = new FlatKDTree(2, vector<vector<double>>());
+    ASSERT_EQ(flatTree->size(), 0u);
+    ASSERT_EQ(flatTree->getNode(vector<double>{1.0, 1.0}), FlatKDTree::NONE);
+    ASSERT_EQ(flatTree->nearestNeighborSearch(vector<double>{1.0, 1.0}), FlatKDTree::NONE);
+}
+
+TEST_F(test_FlatKDTree, FlatKDTree_GetNode)
+{
+    {
+        vector<vector<double>> points = generateFlatPoints(500, 3);
+        FlatKDTree *flatTree = new FlatKDTree(3, points);
+        ASSERT_EQ(flatTree->size(), points.size());
+
+        for (size_t i = 0; i < points.size(); i++) {
+            int id = flatTree->getNode(points[i]);
+            ASSERT_NE(id, FlatKDTree::NONE);
+            ASSERT_TRUE(points[id] == points[i]);
+        }
+        ASSERT_EQ(flatTree->getNode(vector<double>{101.0, 200.0, 3.0}), FlatKDTree::NONE);
+    }
+}
+
+TEST_F(test_FlatKDTree, FlatKDTree_PackedConstructor)
+{
+    {
+        double packed[] = {8.0, 5.0, 3.0, 6.0, 10.0, 2.0};
+        FlatKDTree *flatTree = new FlatKDTree(2, packed, 3);
+        ASSERT_EQ(flatTree->getNode(vector<double>{8.0, 5.0}), 0);
+        ASSERT_EQ(flatTree->getNode(vector<double>{3.0, 6.0}), 1);
+        ASSERT_EQ(flatTree->getNode(vector<double>{10.0, 2.0}), 2);
+    }
+}
+
+TEST_F(test_FlatKDTree, FlatKDTree_NNMatchesBruteForce)
+{
+    {
+        vector<vector<double>> points = generateFlatPoints(1000, 2);
+        vector<vector<double>> targets = generateFlatPoints(100, 2);
+        for (unsigned int leafSize : {1u, 7u, 16u, 64u})
+        for (auto target : targets) {
+            FlatKDTree *flatTree = new FlatKDTree(2, points, leafSize);
+            target[0] += 0.5;
+            double bestDist = numeric_limits<double>::infinity();
+            for (auto point : points) {
+                bestDist = min(bestDist, bruteForceSquaredDistance(point, target));
+            }
+            int id = flatTree->nearestNeighborSearch(target);
+            ASSERT_DOUBLE_EQ(bruteForceSquaredDistance(points[id], target), bestDist);
+            delete flatTree;
+        }
+    }
+}
+
+TEST_F(test_FlatKDTree, FlatKDTree_RangeSearchMatchesBruteForce)
+{
+    {
+        vector<vector<double>> points = generateFlatPoints(1000, 4);
+        FlatKDTree *flatTree = new FlatKDTree(4, points);
+        vector<double> minCorner = vector<double>{10.0, 20.0, 0.0, 30.0};
+        vector<double> maxCorner = vector<double>{60.0, 50.0, 100.0, 70.0};
+
+        vector<int> expected = vector<int>();
+        for (size_t i = 0; i < points.size(); i++) {
+            bool inRange = true;
+            for (size_t d = 0; d < 4; d++) {
+                inRange = inRange && minCorner[d] <= points[i][d] && points[i][d] <= maxCorner[d];
+            }
+            if (inRange) {
+                expected.push_back(i);
+            }
+        }
+
+        vector<int> idsInRange = flatTree->rangeSearch(minCorner, maxCorner);
+        sort(idsInRange.begin(), idsInRange.end());
+        ASSERT_TRUE(idsInRange == expected);
+
+        for (unsigned int leafSize : {1u, 5u, 64u}) {
+            FlatKDTree *bucketTree = new FlatKDTree(4, points, leafSize);
+            idsInRange = bucketTree->rangeSearch(minCorner, maxCorner);
+            sort(idsInRange.begin(), idsInRange.end());
+            ASSERT_TRUE(idsInRange == expected);
+            delete bucketTree;
+        }
+    }
+}
+
+TEST_F(test_FlatKDTree, FlatKDTree_Duplicates)
+{
+    {
+        // more identical points than fit in a leaf, plus a column of points sharing one x value
+        vector<vector<double>> points = vector<vector<double>>(100, vector<double>{5.0, 5.0});
+        for (int i = 0; i < 100; i++) {
+            points.push_back(vector<double>{5.0, (double)i});
+        }
+        FlatKDTree *flatTree = new FlatKDTree(2, points, 4);
+        ASSERT_EQ(flatTree->size(), points.size());
+
+        for (auto point : points) {
+            int id = flatTree->getNode(point);
+            ASSERT_NE(id, FlatKDTree::NONE);
+            ASSERT_TRUE(points[id] == point);
+        }
+        ASSERT_EQ(flatTree->rangeSearch(vector<double>{5.0, 5.0}, vector<double>{5.0, 5.0}).size(), 101u);
+    }
+}
+
+TEST_F(test_FlatKDTree, FlatKDTree_DuplicateRunsLongerThanLeaves)
+{
+    {
+        // a run of identical points several times larger than the largest leaf must still be cut into leaves
+        const int copies = 1000;
+        vector<vector<double>> points = vector<vector<double>>(copies, vector<double>{1.0, 2.0});
+        points.push_back(vector<double>{5.0, 5.0});
+        FlatKDTree tree(2, points, 16);
+        ASSERT_EQ(tree.size(), points.size());
+
+        ASSERT_LT(tree.getNode(vector<double>{1.0, 2.0}), copies);
+        ASSERT_EQ(tree.getNode(vector<double>{5.0, 5.0}), copies);
+        ASSERT_LT(tree.nearestNeighborSearch(vector<double>{1.5, 2.0}), copies);
+        ASSERT_EQ(tree.nearestNeighborSearch(vector<double>{4.0, 4.5}), copies);
+
+        vector<FlatKDTree::Neighbor> neighbors = tree.kNearest(vector<double>{1.0, 2.0}, 300);
+        ASSERT_EQ(neighbors.size(), 300u);
+        for (const FlatKDTree::Neighbor &neighbor : neighbors) {
+            ASSERT_LT(neighbor.id, copies);
+            ASSERT_EQ(neighbor.distance, 0.0);
+        }
+        neighbors = tree.kNearest(vector<double>{5.0, 5.0}, 2);
+        ASSERT_EQ(neighbors[0].id, copies);
+        ASSERT_DOUBLE_EQ(neighbors[1].distance, 5.0);
+
+        ASSERT_EQ(tree.rangeSearch(vector<double>{1.0, 2.0}, vector<double>{1.0, 2.0}).size(), (size_t)copies);
+        ASSERT_EQ(tree.rangeSearch(vector<double>{0.0, 0.0}, vector<double>{5.0, 5.0}).size(), points.size());
+        ASSERT_EQ(tree.rangeSearch(vector<double>{1.5, 0.0}, vector<double>{5.0, 5.0}).size(), 1u);
+
+        vector<FlatKDTree::Neighbor> all = tree.allKNearest(2, 1);
+        ASSERT_EQ(all.size(), points.size() * 2);
+        for (int i = 0; i < copies; i++) {
+            for (int n = 0; n < 2; n++) {
+                ASSERT_NE(all[i * 2 + n].id, i);
+                ASSERT_LT(all[i * 2 + n].id, copies);
+                ASSERT_EQ(all[i * 2 + n].distance, 0.0);
+            }
+        }
+        ASSERT_LT(all[copies * 2].id, copies);
+        ASSERT_DOUBLE_EQ(all[copies * 2].distance, 5.0);
+    }
+}
+
+TEST_F(test_FlatKDTree, FlatKDTree_LeafKernels)
+{
+    {
+        // 3 points of 2 dimensions stored structure-of-arrays, plus 6 more to cover the vector loops and tails
+        unsigned int count = 9;
+        vector<double> block = vector<double>();
+        for (unsigned int i = 0; i < count; i++) {
+            block.push_back(i);
+        }
+        for (unsigned int i = 0; i < count; i++) {
+            block.push_back(10.0 * i);
+        }
+        double query[] = {2.0, 10.0};
+        double distances[9];
+        squaredDistancesSoA(block.data(), count, 2, query, distances);
+        for (unsigned int i = 0; i < count; i++) {
+            ASSERT_DOUBLE_EQ(distances[i], (i - 2.0) * (i - 2.0) + (10.0 * i - 10.0) * (10.0 * i - 10.0));
+        }
+
+        double minCorner[] = {1.0, 20.0};
+        double maxCorner[] = {8.0, 70.0};
+        unsigned char inside[9];
+        ASSERT_EQ(inBoxSoA(block.data(), count, 2, minCorner, maxCorner, inside), 6u);
+        for (unsigned int i = 0; i < count; i++) {
+            ASSERT_EQ(inside[i], (i >= 2 && i <= 7) ? 1 : 0);
+        }
+    }
+}
+
+TEST_F(test_FlatKDTree, FlatKDTree_SaveAndMap)
+{
+    {
+        vector<vector<double>> points = generateFlatPoints(2000, 3);
+        FlatKDTree *flatTree = new FlatKDTree(3, points, 8);
+        string path = "test_FlatKDTree_SaveAndMap.fkd";
+        flatTree->save(path);
+
+        FlatKDTree *mappedTree = new FlatKDTree(path);
+        ASSERT_TRUE(mappedTree->isMapped());
+        ASSERT_FALSE(flatTree->isMapped());
+        ASSERT_EQ(mappedTree->getDimensions(), 3);
+        ASSERT_EQ(mappedTree->getLeafSize(), 8u);
+        ASSERT_EQ(mappedTree->size(), points.size());
+
+        vector<double> minCorner = vector<double>{10.0, 20.0, 30.0};
+        vector<double> maxCorner = vector<double>{60.0, 50.0, 90.0};
+        ASSERT_TRUE(mappedTree->rangeSearch(minCorner, maxCorner) == flatTree->rangeSearch(minCorner, maxCorner));
+        for (size_t i = 0; i < points.size(); i += 7) {
+            ASSERT_EQ(mappedTree->getNode(points[i]), flatTree->getNode(points[i]));
+            vector<double> target = vector<double>{points[i][0] + 0.5, points[i][1] - 0.25, points[i][2]};
+            ASSERT_EQ(mappedTree->nearestNeighborSearch(target), flatTree->nearestNeighborSearch(target));
+        }
+        delete mappedTree;
+
+        // a truncated file and a file of another kind are both refused
+        {
+            ifstream in(path.c_str(), ios::binary);
+            string contents((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+            ofstream out(path.c_str(), ios::binary | ios::trunc);
+            out.write(contents.data(), contents.size() - 4);
+        }
+        ASSERT_THROW(FlatKDTree truncated(path), runtime_error);
+        {
+            ofstream out(path.c_str(), ios::binary | ios::trunc);
+            out << "not a tree, just some text that is long enough to hold a header";
+        }
+        ASSERT_THROW(FlatKDTree other(path), runtime_error);
+        remove(path.c_str());
+        ASSERT_THROW(FlatKDTree missing(path), runtime_error);
+
+        FlatKDTree *emptyTree = new FlatKDTree(2, vector<vector<double>>());
+        emptyTree->save(path);
+        FlatKDTree *mappedEmpty = new FlatKDTree(path);
+        ASSERT_EQ(mappedEmpty->size(), 0u);
+        ASSERT_EQ(mappedEmpty->nearestNeighborSearch(vector<double>{1.0, 2.0}), FlatKDTree::NONE);
+        delete mappedEmpty;
+        remove(path.c_str());
+    }
+}
+
+TEST_F(test_FlatKDTree, FlatKDTree_SaveAndMapDuplicates)
+{
+    {
+        // mapping checks every leaf holds at most leafSize points, so runs of duplicates must be saved split
+        vector<vector<double>> points = generateFlatPoints(500, 2);
+        for (int i = 0; i < 700; i++) {
+            points.push_back(vector<double>{3.0, 4.0});
+        }
+        for (int i = 0; i < 300; i++) {
+            points.push_back(points[i % 7]);
+        }
+        FlatKDTree flatTree(2, points, 4);
+        string path = "test_FlatKDTree_SaveAndMapDuplicates.fkd";
+        flatTree.save(path);
+
+        FlatKDTree mappedTree(path);
+        ASSERT_TRUE(mappedTree.isMapped());
+        ASSERT_EQ(mappedTree.size(), points.size());
+        ASSERT_EQ(mappedTree.rangeSearch(vector<double>{3.0, 4.0}, vector<double>{3.0, 4.0}).size(),
+            flatTree.rangeSearch(vector<double>{3.0, 4.0}, vector<double>{3.0, 4.0}).size());
+        ASSERT_GE(mappedTree.rangeSearch(vector<double>{3.0, 4.0}, vector<double>{3.0, 4.0}).size(), 700u);
+        for (size_t i = 0; i < points.size(); i += 11) {
+            int id = mappedTree.getNode(points[i]);
+            ASSERT_NE(id, FlatKDTree::NONE);
+            ASSERT_TRUE(points[id] == points[i]);
+            ASSERT_EQ(mappedTree.kNearest(points[i], 1)[0].distance, 0.0);
+        }
+        vector<int> nearest = mappedTree.allNearestNeighbors();
+        ASSERT_TRUE(points[nearest[600]] == points[600]);
+        remove(path.c_str());
+    }
+}
+
+string readFileBytes(const string &path)
+{
+    ifstream in(path.c_str(), ios::binary);
+    return string((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+}
+
+void writeFileBytes(const string &path, const string &contents)
+{
+    ofstream out(path.c_str(), ios::binary | ios::trunc);
+    out.write(contents.data(), contents.size());
+}
+
+template <typename T>
+string patchFileBytes(string contents, size_t offset, T value)
+{
+    memcpy(&contents[offset], &value, sizeof(T));
+    return contents;
+}
+
+TEST_F(test_FlatKDTree, FlatKDTree_MapRejectsCorruptFiles)
+{
+    {
+        vector<vector<double>> points = generateFlatPoints(500, 2);
+        FlatKDTree tree(2, points, 4);
+        string path = "test_FlatKDTree_MapRejectsCorruptFiles.fkd";
+        tree.save(path);
+        string contents = readFileBytes(path);
+
+        // header: magic, 6 uint32 fields, nodeCount at byte 32 and pointCount at byte 40, then the nodes
+        const size_t nodeCountOffset = 32;
+        const size_t nodesOffset = 48;
+        const size_t nodeLeftOffset = 8;
+        const size_t nodeFirstOffset = 16;
+        uint64_t nodeCount;
+        memcpy(&nodeCount, &contents[nodeCountOffset], sizeof(nodeCount));
+        ASSERT_EQ(sizeof(FlatKDTree::FlatNode), 24u);
+        {
+            FlatKDTree intact(path);
+            ASSERT_EQ(intact.size(), points.size());
+        }
+
+        // truncated inside the id array
+        writeFileBytes(path, contents.substr(0, contents.size() - 12));
+        ASSERT_THROW(FlatKDTree truncated(path), runtime_error);
+
+        // a node count that only matches the file length once its size wraps around 64 bits
+        writeFileBytes(path, patchFileBytes<uint64_t>(contents, nodeCountOffset, nodeCount + (1ull << 61)));
+        ASSERT_THROW(FlatKDTree overflowed(path), runtime_error);
+
+        // the root's left child past the end of the node array, or pointing back at the root
+        writeFileBytes(path, patchFileBytes<int>(contents, nodesOffset + nodeLeftOffset, (int)nodeCount + 5));
+        ASSERT_THROW(FlatKDTree outOfBounds(path), runtime_error);
+        writeFileBytes(path, patchFileBytes<int>(contents, nodesOffset + nodeLeftOffset, 0));
+        ASSERT_THROW(FlatKDTree cycle(path), runtime_error);
+
+        // the last node is a leaf, its points pushed past the point slots
+        size_t lastNode = nodesOffset + (nodeCount - 1) * sizeof(FlatKDTree::FlatNode);
+        writeFileBytes(path, patchFileBytes<unsigned int>(contents, lastNode + nodeFirstOffset, (unsigned int)points.size()));
+        ASSERT_THROW(FlatKDTree leafOutOfBounds(path), runtime_error);
+
+        // the last id out of range
+        writeFileBytes(path, patchFileBytes<int>(contents, contents.size() - sizeof(int), (int)points.size()));
+        ASSERT_THROW(FlatKDTree badId(path), runtime_error);
+        remove(path.c_str());
+    }
+}
+
+TEST_F(test_FlatKDTree, FlatKDTree_AllNearestNeighbors)
+{
+    {
+        const unsigned int k = 3;
+        vector<vector<double>> points = generateFlatPoints(1500, k);
+        // an exact duplicate is the other point's nearest neighbor at distance 0
+        points.push_back(points[7]);
+        FlatKDTree tree(k, points, 8);
+
+        vector<FlatKDTree::Neighbor> neighbors = tree.allKNearest(3, 1);
+        ASSERT_EQ(neighbors.size(), points.size() * 3);
+        for (size_t i = 0; i < points.size(); i++) {
+            vector<double> distances;
+            for (size_t j = 0; j < points.size(); j++) {
+                if (j != i) {
+                    distances.push_back(bruteForceSquaredDistance(points[i], points[j]));
+                }
+            }
+            sort(distances.begin(), distances.end());
+            for (size_t n = 0; n < 3; n++) {
+                const FlatKDTree::Neighbor &neighbor = neighbors[i * 3 + n];
+                ASSERT_NE(neighbor.id, (int)i);
+                ASSERT_NEAR(neighbor.distance, sqrt(bruteForceSquaredDistance(points[i], points[neighbor.id])), 1e-9);
+                ASSERT_NEAR(neighbor.distance, sqrt(distances[n]), 1e-9);
+            }
+        }
+        vector<int> nearest = tree.allNearestNeighbors();
+        ASSERT_EQ(neighbors[7 * 3].distance, 0.0);
+        ASSERT_EQ(neighbors[(points.size() - 1) * 3].distance, 0.0);
+        ASSERT_TRUE(points[nearest[points.size() - 1]] == points[7]);
+
+        vector<FlatKDTree::Neighbor> threaded = tree.allKNearest(3, 4);
+        for (size_t i = 0; i < neighbors.size(); i++) {
+            ASSERT_EQ(threaded[i].distance, neighbors[i].distance);
+        }
+
+        FlatKDTree single(k, vector<vector<double>>{points[0]});
+        ASSERT_EQ(single.allNearestNeighbors()[0], FlatKDTree::NONE);
+    }
+}
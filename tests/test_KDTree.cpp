@@ -1,9 +1,11 @@
 // Chekout TEST_F functions bellow to learn what is being tested.
+#include <algorithm>
 #include <cmath>
 #include <ctime>
 #include <fstream>
 #include <iostream>
 #include <math.h>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <cstdlib>
@@ -284,6 +286,32 @@ TEST_F(test_KDTree, KDTree_RemoveInternalNodePreset)
     }
 }
 
+TEST_F(test_KDTree, KDTree_RemoveKeepsRemainingPointsReachable)
+{
+    {
+        // removing a node copies the minimum of its subtree on the node's axis into it, every other point
+        // must stay reachable by getNode afterwards
+        vector<vector<double>> points;
+        for (int i = 0; i < 200; i++) {
+            points.push_back(vector<double>{(double)((i * 37) % 101), (double)((i * 53) % 103), (double)((i * 11) % 97)});
+        }
+        KDTree *kdTree = new KDTree(3);
+        for (auto point : points) {
+            kdTree->setRoot(kdTree->insertNode(point));
+        }
+
+        for (size_t removed = 0; removed < points.size(); removed++) {
+            kdTree->setRoot(kdTree->removeNode(points[removed]));
+            ASSERT_TRUE(kdTree->getNode(points[removed]) == nullptr);
+            for (size_t i = removed + 1; i < points.size(); i++) {
+                ASSERT_TRUE(kdTree->getNode(points[i]) != nullptr);
+            }
+        }
+        ASSERT_TRUE(kdTree->getRoot() == nullptr);
+        delete kdTree;
+    }
+}
+
 TEST_F(test_KDTree, KDTree_NNPreset)
 {
     {
@@ -369,3 +397,799 @@ TEST_F(test_KDTree, KDTree_3DInsertComplex)
         ASSERT_TRUE(kdTree->getNode(points[3])->getRightNode()->getPoint() == points[7]);
     }
 }
+
+TEST_F(test_KDTree, KDTree_BuildBalancedFromSortedPoints)
+{
+    {
+        // sorted input is the worst case for insertNode, build must still produce a balanced tree
+        vector<vector<double>> points = vector<vector<double>>();
+        for (int i = 0; i < 1023; i++) {
+            points.push_back(vector<double>{(double)i, (double)i});
+        }
+        KDTree *kdTree = new KDTree(points[0].size());
+        kdTree->build(points);
+
+        KDTree::BalanceReport report = kdTree->balanceReport();
+        ASSERT_EQ(report.nodeCount, points.size());
+        ASSERT_EQ(report.height, report.optimalHeight);
+        ASSERT_EQ(report.height, 10u);
+
+        for (auto point : points) {
+            ASSERT_TRUE(kdTree->getNode(point) != nullptr);
+        }
+    }
+}
+
+TEST_F(test_KDTree, KDTree_BuildWithDuplicates)
+{
+    {
+        vector<vector<double>> points = generate2DSpacePoints(200);
+        for (int i = 0; i < 50; i++) {
+            points.push_back(vector<double>{5.0, (double)i});
+        }
+        KDTree *kdTree = new KDTree(points[0].size());
+        kdTree->build(points);
+
+        ASSERT_EQ(kdTree->balanceReport().nodeCount, points.size());
+        for (auto point : points) {
+            ASSERT_TRUE(kdTree->getNode(point) != nullptr);
+        }
+    }
+}
+
+TEST_F(test_KDTree, KDTree_BuildWrongDimensions)
+{
+    {
+        KDTree *kdTree = new KDTree(3);
+        bool seenError = false;
+        try {
+            kdTree->build(getComplexPresetPoints());
+        } catch (const invalid_argument& e) {
+            seenError = true;
+        }
+        ASSERT_TRUE(seenError);
+    }
+}
+
+TEST_F(test_KDTree, KDTree_RangeSearchKDimensional)
+{
+    {
+        srand(time(0));
+        vector<vector<double>> points = vector<vector<double>>();
+        for (int i = 0; i < 500; i++) {
+            points.push_back(vector<double>{genDbl0_100(), genDbl0_100(), genDbl0_100(), genDbl0_100(), genDbl0_100()});
+        }
+        KDTree *kdTree = new KDTree(points[0].size());
+        for (auto point : points)
+        {
+            kdTree->setRoot(kdTree->insertNode(point));
+        }
+
+        vector<double> minCorner = vector<double>{10.0, 0.0, 20.0, 0.0, 40.0};
+        vector<double> maxCorner = vector<double>{70.0, 100.0, 80.0, 50.0, 90.0};
+        size_t expected = 0;
+        for (auto point : points) {
+            bool inRange = true;
+            for (size_t d = 0; d < point.size(); d++) {
+                inRange = inRange && minCorner[d] <= point[d] && point[d] <= maxCorner[d];
+            }
+            expected += inRange;
+        }
+
+        vector<Node*> nodesInRange = kdTree->rangeSearch(minCorner, maxCorner);
+        ASSERT_EQ(nodesInRange.size(), expected);
+        for (Node* node : nodesInRange) {
+            for (size_t d = 0; d < minCorner.size(); d++) {
+                ASSERT_TRUE(minCorner[d] <= node->getPoint()[d] && node->getPoint()[d] <= maxCorner[d]);
+            }
+        }
+    }
+}
+
+TEST_F(test_KDTree, KDTree_KNearestPreset)
+{
+    {
+        vector<vector<double>> points = getComplexPresetPoints();
+        KDTree *kdTree = new KDTree(points[0].size());
+        for (auto point : points)
+        {
+            kdTree->setRoot(kdTree->insertNode(point));
+        }
+
+        // nearest to (9,1): itself, (10,2) at sqrt(2), (11,0) at sqrt(5)
+        vector<KDTree::Neighbor> neighbors = kdTree->kNearest(points[4], 3);
+        ASSERT_EQ(neighbors.size(), 3u);
+        ASSERT_TRUE(neighbors[0].node->getPoint() == points[4]);
+        ASSERT_DOUBLE_EQ(neighbors[0].distance, 0.0);
+        ASSERT_TRUE(neighbors[1].node->getPoint() == points[2]);
+        ASSERT_DOUBLE_EQ(neighbors[1].distance, sqrt(2.0));
+        ASSERT_TRUE(neighbors[2].node->getPoint() == points[6]);
+        ASSERT_DOUBLE_EQ(neighbors[2].distance, sqrt(5.0));
+
+        neighbors = kdTree->kNearest(points[4], 2, false);
+        ASSERT_EQ(neighbors.size(), 2u);
+        ASSERT_TRUE(neighbors[0].node->getPoint() == points[2]);
+        ASSERT_TRUE(neighbors[1].node->getPoint() == points[6]);
+
+        ASSERT_EQ(kdTree->kNearest(points[4], 20).size(), points.size());
+    }
+}
+
+TEST_F(test_KDTree, KDTree_KNearestMatchesBruteForce)
+{
+    {
+        vector<vector<double>> points = generate2DSpacePoints(1000);
+        KDTree *kdTree = new KDTree(points[0].size());
+        kdTree->build(points);
+        vector<double> query = vector<double>{50.5, 49.5};
+
+        vector<double> distances = vector<double>();
+        for (auto point : points) {
+            distances.push_back(sqrt(pow(point[0] - query[0], 2) + pow(point[1] - query[1], 2)));
+        }
+        sort(distances.begin(), distances.end());
+
+        vector<KDTree::Neighbor> neighbors = kdTree->kNearest(query, 16);
+        ASSERT_EQ(neighbors.size(), 16u);
+        for (size_t i = 0; i < neighbors.size(); i++) {
+            ASSERT_DOUBLE_EQ(neighbors[i].distance, distances[i]);
+        }
+    }
+}
+
+TEST_F(test_KDTree, KDTree_BatchQueriesMatchSingleQueries)
+{
+    {
+        vector<vector<double>> points = generate2DSpacePoints(2000);
+        KDTree *kdTree = new KDTree(points[0].size());
+        kdTree->build(points);
+
+        size_t queryCount = 1000;
+        unsigned int count = 4;
+        vector<double> queries = vector<double>();
+        vector<double> maxCorners = vector<double>();
+        for (size_t i = 0; i < queryCount; i++) {
+            vector<double> point = points[i % points.size()];
+            queries.insert(queries.end(), point.begin(), point.end());
+            maxCorners.push_back(point[0] + 10.0);
+            maxCorners.push_back(point[1] + 10.0);
+        }
+
+        vector<Node*> found = vector<Node*>(queryCount);
+        vector<Node*> nearest = vector<Node*>(queryCount);
+        vector<KDTree::Neighbor> neighbors = vector<KDTree::Neighbor>(queryCount * count);
+        vector<vector<Node*>> inRange = vector<vector<Node*>>(queryCount);
+        kdTree->batchGetNode(queries.data(), queryCount, found.data(), 4);
+        kdTree->batchNearestNeighbor(queries.data(), queryCount, nearest.data(), 4);
+        kdTree->batchKNearest(queries.data(), queryCount, count, neighbors.data(), 4);
+        kdTree->batchRangeSearch(queries.data(), maxCorners.data(), queryCount, inRange.data(), 4);
+
+        for (size_t i = 0; i < queryCount; i++) {
+            vector<double> query = vector<double>(queries.begin() + i * 2, queries.begin() + i * 2 + 2);
+            ASSERT_TRUE(found[i] == kdTree->getNode(query));
+            ASSERT_TRUE(nearest[i]->getPoint() == query);
+
+            vector<KDTree::Neighbor> expected = kdTree->kNearest(query, count);
+            for (unsigned int j = 0; j < count; j++) {
+                ASSERT_DOUBLE_EQ(neighbors[i * count + j].distance, expected[j].distance);
+            }
+
+            vector<double> maxCorner = vector<double>{query[0] + 10.0, query[1] + 10.0};
+            ASSERT_TRUE(inRange[i] == kdTree->rangeSearch(query, maxCorner));
+        }
+    }
+}
+
+TEST_F(test_KDTree, KDTree_PoolReusesRemovedNodes)
+{
+    {
+        vector<vector<double>> points = getComplexPresetPoints();
+        KDTree *kdTree = new KDTree(points[0].size());
+        kdTree->reserve(points.size());
+        size_t reservedBytes = kdTree->memoryBytes();
+        for (auto point : points)
+        {
+            kdTree->setRoot(kdTree->insertNode(point));
+        }
+        ASSERT_EQ(kdTree->memoryBytes(), reservedBytes);
+
+        kdTree->setRoot(kdTree->removeNode(points[4]));
+        kdTree->setRoot(kdTree->removeNode(points[1]));
+        ASSERT_EQ(kdTree->balanceReport().nodeCount, points.size() - 2);
+
+        // removed slots are reused instead of growing the pool
+        kdTree->setRoot(kdTree->insertNode(points[4]));
+        kdTree->setRoot(kdTree->insertNode(points[1]));
+        ASSERT_EQ(kdTree->memoryBytes(), reservedBytes);
+        for (auto point : points) {
+            ASSERT_TRUE(kdTree->getNode(point) != nullptr);
+            ASSERT_TRUE(kdTree->getNode(point)->isPooled());
+        }
+        delete kdTree;
+    }
+}
+
+TEST_F(test_KDTree, KDTree_RemoveLeavesHandAttachedNodesToCreator)
+{
+    {
+        vector<vector<double>> points = getSimplePresetPoints();
+        Node *root = new Node(points[0]);
+        Node *left = new Node(points[1]);
+        Node *right = new Node(points[2]);
+        root->setLeftNode(left);
+        root->setRightNode(right);
+        KDTree *kdTree = new KDTree(2);
+        kdTree->setRoot(root);
+
+        // the removed leaf is unlinked but not freed, the test still owns all three nodes
+        kdTree->removeNode(points[1]);
+        ASSERT_TRUE(kdTree->getNode(points[1]) == nullptr);
+        ASSERT_TRUE(root->getLeftNode() == nullptr);
+        ASSERT_TRUE(left->getPoint() == points[1]);
+
+        kdTree->setLazyDeletion(true);
+        kdTree->removeNode(points[2]);
+        kdTree->compact();
+        ASSERT_TRUE(kdTree->getNode(points[2]) == nullptr);
+        ASSERT_TRUE(right->getPoint() == points[2]);
+
+        delete kdTree;
+        delete root;
+        delete left;
+        delete right;
+    }
+}
+
+TEST_F(test_KDTree, KDTree_Clear)
+{
+    {
+        vector<vector<double>> points = generate2DSpacePoints(3000);
+        KDTree *kdTree = new KDTree(points[0].size());
+        kdTree->build(points);
+        size_t memoryBytes = kdTree->memoryBytes();
+        ASSERT_TRUE(memoryBytes > 0);
+
+        kdTree->clear();
+        ASSERT_TRUE(kdTree->getRoot() == nullptr);
+        ASSERT_EQ(kdTree->balanceReport().nodeCount, 0u);
+
+        // rebuilding reuses the slabs kept by clear
+        kdTree->build(points);
+        ASSERT_EQ(kdTree->memoryBytes(), memoryBytes);
+        ASSERT_EQ(kdTree->balanceReport().nodeCount, points.size());
+        delete kdTree;
+    }
+}
+
+TEST_F(test_KDTree, KDTree_RadiusSearchPreset)
+{
+    {
+        vector<vector<double>> points = getComplexPresetPoints();
+        KDTree *kdTree = new KDTree(points[0].size());
+        for (auto point : points)
+        {
+            kdTree->setRoot(kdTree->insertNode(point));
+        }
+
+        // around (9,1): itself, (10,2) at sqrt(2) and (11,0) at sqrt(5) exactly on the boundary
+        vector<KDTree::Neighbor> neighbors = kdTree->radiusSearch(points[4], sqrt(5.0));
+        ASSERT_EQ(neighbors.size(), 3u);
+        ASSERT_EQ(kdTree->radiusCount(points[4], sqrt(5.0)), 3u);
+        for (auto neighbor : neighbors) {
+            ASSERT_TRUE(neighbor.distance <= sqrt(5.0));
+        }
+        ASSERT_EQ(kdTree->radiusCount(points[4], 1.0), 1u);
+        ASSERT_EQ(kdTree->radiusCount(points[4], -1.0), 0u);
+    }
+}
+
+TEST_F(test_KDTree, KDTree_RadiusCountMatchesBruteForce)
+{
+    {
+        vector<vector<double>> points = generate2DSpacePoints(2000);
+        KDTree *kdTree = new KDTree(points[0].size());
+        kdTree->build(points);
+
+        for (double radius : {0.0, 3.5, 10.0, 40.0}) {
+            vector<double> query = vector<double>{50.0, 50.0};
+            size_t expected = 0;
+            for (auto point : points) {
+                expected += pow(point[0] - query[0], 2) + pow(point[1] - query[1], 2) <= radius * radius;
+            }
+            ASSERT_EQ(kdTree->radiusCount(query, radius), expected);
+            ASSERT_EQ(kdTree->radiusSearch(query, radius).size(), expected);
+        }
+    }
+}
+
+TEST_F(test_KDTree, KDTree_ApproximateNearestNeighbor)
+{
+    {
+        vector<vector<double>> points = generate2DSpacePoints(3000);
+        KDTree *kdTree = new KDTree(points[0].size());
+        kdTree->build(points);
+        vector<vector<double>> queries = vector<vector<double>>{{50.5, 49.5}, {0.25, 99.75}, {-10.0, 20.0}, {33.3, 66.6}};
+
+        for (auto query : queries) {
+            double exact = kdTree->kNearest(query, 1)[0].distance;
+
+            // epsilon 0 without a budget is an exact search
+            KDTree::Neighbor neighbor = kdTree->approximateNearestNeighbor(query, 0.0);
+            ASSERT_DOUBLE_EQ(neighbor.distance, exact);
+
+            neighbor = kdTree->approximateNearestNeighbor(query, 0.5);
+            ASSERT_TRUE(neighbor.node != nullptr);
+            ASSERT_TRUE(neighbor.distance <= 1.5 * exact + 1e-9);
+
+            // a budget of one visit only looks at the root
+            neighbor = kdTree->approximateNearestNeighbor(query, 0.0, 1);
+            ASSERT_TRUE(neighbor.node == kdTree->getRoot());
+        }
+
+        ASSERT_TRUE((new KDTree(2))->approximateNearestNeighbor(queries[0], 0.0).node == nullptr);
+    }
+}
+
+TEST_F(test_KDTree, KDTree_SelfBalancingSortedInserts)
+{
+    {
+        KDTree *kdTree = new KDTree(2);
+        kdTree->setSelfBalancing(true);
+        ASSERT_TRUE(kdTree->isSelfBalancing());
+        const int count = 4000;
+
+        for (int i = 0; i < count; i++) {
+            kdTree->insertNode(vector<double>{(double)i, (double)(count - i)});
+        }
+
+        KDTree::BalanceReport report = kdTree->balanceReport();
+        ASSERT_EQ(report.nodeCount, (size_t)count);
+        // an alpha of 0.7 bounds the height by log(n) / log(1 / 0.7) + 1
+        ASSERT_TRUE(report.height <= log((double)count) / log(1.0 / 0.7) + 1);
+        ASSERT_EQ(kdTree->getRoot()->getSubtreeSize(), (unsigned int)count);
+        for (int i = 0; i < count; i++) {
+            ASSERT_TRUE(kdTree->getNode(vector<double>{(double)i, (double)(count - i)}) != nullptr);
+        }
+
+        for (int i = 0; i < count; i += 2) {
+            kdTree->removeNode(vector<double>{(double)i, (double)(count - i)});
+        }
+        report = kdTree->balanceReport();
+        ASSERT_EQ(report.nodeCount, (size_t)count / 2);
+        ASSERT_EQ(kdTree->getRoot()->getSubtreeSize(), (unsigned int)count / 2);
+        ASSERT_TRUE(report.height <= log((double)count) / log(1.0 / 0.7) + 1);
+        for (int i = 0; i < count; i++) {
+            ASSERT_EQ(kdTree->getNode(vector<double>{(double)i, (double)(count - i)}) != nullptr, i % 2 == 1);
+        }
+
+        ASSERT_THROW(kdTree->setSelfBalancing(true, 0.5), invalid_argument);
+        ASSERT_THROW(kdTree->setSelfBalancing(true, 1.0), invalid_argument);
+    }
+}
+
+TEST_F(test_KDTree, KDTree_LazyDeletion)
+{
+    {
+        // distinct points, so each removal tombstones exactly the node it names
+        vector<vector<double>> points;
+        for (int i = 0; i < 1000; i++) {
+            points.push_back(vector<double>{(double)i, (double)((i * 7) % 1000)});
+        }
+        KDTree *kdTree = new KDTree(2);
+        kdTree->build(points);
+        kdTree->setLazyDeletion(true, 0.6);
+        ASSERT_TRUE(kdTree->isLazyDeletion());
+        Node *root = kdTree->getRoot();
+
+        for (size_t i = 0; i < points.size(); i += 2) {
+            kdTree->removeNode(points[i]);
+        }
+        // only tombstoned, the structure is untouched
+        ASSERT_TRUE(kdTree->getRoot() == root);
+        ASSERT_EQ(kdTree->balanceReport().nodeCount, points.size());
+        ASSERT_DOUBLE_EQ(kdTree->deadRatio(), 0.5);
+
+        vector<double> minCorner = {0.0, 0.0};
+        vector<double> maxCorner = {1000.0, 1000.0};
+        ASSERT_EQ(kdTree->rangeSearch(minCorner, maxCorner).size(), points.size() / 2);
+        ASSERT_EQ(kdTree->radiusCount(points[0], 2000.0), points.size() / 2);
+        for (size_t i = 0; i < points.size(); i++) {
+            ASSERT_EQ(kdTree->getNode(points[i]) != nullptr, i % 2 == 1);
+            Node *nearest = kdTree->nearestNeighborSearch(points[i]);
+            ASSERT_FALSE(nearest->isDeleted());
+            for (KDTree::Neighbor neighbor : kdTree->kNearest(points[i], 3)) {
+                ASSERT_FALSE(neighbor.node->isDeleted());
+            }
+            ASSERT_FALSE(kdTree->approximateNearestNeighbor(points[i], 0.0).node->isDeleted());
+        }
+
+        // going over the threshold compacts the tree
+        for (size_t i = 1; i < points.size() / 4; i += 2) {
+            kdTree->removeNode(points[i]);
+        }
+        ASSERT_TRUE(kdTree->deadRatio() < 0.6);
+        kdTree->compact();
+        ASSERT_DOUBLE_EQ(kdTree->deadRatio(), 0.0);
+        size_t live = kdTree->balanceReport().nodeCount;
+        ASSERT_EQ(live, kdTree->rangeSearch(minCorner, maxCorner).size());
+        ASSERT_TRUE(live < points.size() / 2);
+        ASSERT_TRUE(kdTree->balanceReport().height <= kdTree->balanceReport().optimalHeight);
+
+        ASSERT_THROW(kdTree->setLazyDeletion(true, 0.0), invalid_argument);
+        kdTree->removeNode(points[points.size() - 1]);
+        kdTree->setLazyDeletion(false);
+        ASSERT_EQ(kdTree->balanceReport().nodeCount, live - 1);
+    }
+}
+
+void collectPreorder(Node *node, vector<double> &out)
+{
+    if (node == nullptr) {
+        out.push_back(-1.0);
+        return;
+    }
+    out.insert(out.end(), node->getPoint().begin(), node->getPoint().end());
+    collectPreorder(node->getLeftNode(), out);
+    collectPreorder(node->getRightNode(), out);
+}
+
+TEST_F(test_KDTree, KDTree_ParallelBuildIsDeterministic)
+{
+    {
+        vector<vector<double>> points;
+        for (int i = 0; i < 100000; i++) {
+            points.push_back(vector<double>{(double)((i * 7919) % 1000), (double)((i * 7907) % 997), (double)(i % 13)});
+        }
+        KDTree *serialTree = new KDTree(3);
+        serialTree->build(points);
+        vector<double> expected;
+        collectPreorder(serialTree->getRoot(), expected);
+
+        for (unsigned int threadCount : {2u, 3u, 8u, 0u}) {
+            KDTree *parallelTree = new KDTree(3);
+            parallelTree->build(points, threadCount);
+            vector<double> actual;
+            collectPreorder(parallelTree->getRoot(), actual);
+            ASSERT_TRUE(actual == expected);
+            ASSERT_EQ(parallelTree->getRoot()->getSubtreeSize(), points.size());
+            delete parallelTree;
+        }
+        delete serialTree;
+    }
+}
+
+// checks that every node of the subtree lies in the box its ancestors' splits allow: below each split on the left,
+// at or above it on the right
+bool obeysSplits(Node *node, unsigned int k, unsigned int depth, vector<double> low, vector<double> high)
+{
+    if (node == nullptr) {
+        return true;
+    }
+    for (unsigned int i = 0; i < k; i++) {
+        if (node->getPoint()[i] < low[i] || node->getPoint()[i] >= high[i]) {
+            return false;
+        }
+    }
+    unsigned int d = depth % k;
+    vector<double> leftHigh = high;
+    leftHigh[d] = node->getPoint()[d];
+    vector<double> rightLow = low;
+    rightLow[d] = node->getPoint()[d];
+    return obeysSplits(node->getLeftNode(), k, depth + 1, low, leftHigh) && obeysSplits(node->getRightNode(), k, depth + 1, rightLow, high);
+}
+
+TEST_F(test_KDTree, KDTree_LargeBuildKeepsMedianSplits)
+{
+    {
+        // large enough for the top levels to go through the sampled selection, with long runs of equal values
+        vector<vector<double>> points;
+        for (int i = 0; i < 60000; i++) {
+            points.push_back(vector<double>{(double)(i % 7 == 0 ? 3 : (i * 31) % 50), (double)((i * 17) % 23)});
+        }
+        vector<double> sortedFirst;
+        for (const vector<double> &point : points) {
+            sortedFirst.push_back(point[0]);
+        }
+        sort(sortedFirst.begin(), sortedFirst.end());
+        vector<double> low(2, -numeric_limits<double>::infinity());
+        vector<double> high(2, numeric_limits<double>::infinity());
+        for (unsigned int threadCount : {1u, 4u}) {
+            KDTree *kdTree = new KDTree(2);
+            kdTree->build(points, threadCount);
+            ASSERT_TRUE(obeysSplits(kdTree->getRoot(), 2, 0, low, high));
+            ASSERT_EQ(kdTree->getRoot()->getSubtreeSize(), points.size());
+            ASSERT_EQ(kdTree->getRoot()->getPoint()[0], sortedFirst[points.size() / 2]);
+            delete kdTree;
+        }
+    }
+}
+
+TEST_F(test_KDTree, KDTree_DegenerateTreeDoesNotOverflow)
+{
+    {
+        // a chain as deep as sorted input builds with insertNode, linked by hand to keep the test fast
+        const int count = 300000;
+        vector<Node *> chain;
+        for (int i = 0; i < count; i++) {
+            chain.push_back(new Node(vector<double>{(double)i, (double)i}));
+            if (i > 0) {
+                chain[i - 1]->setRightNode(chain[i]);
+            }
+        }
+        KDTree *kdTree = new KDTree(2);
+        kdTree->setRoot(chain[0]);
+
+        vector<double> last = vector<double>{(double)(count - 1), (double)(count - 1)};
+        ASSERT_TRUE(kdTree->getNode(last) == chain[count - 1]);
+        ASSERT_TRUE(kdTree->nearestNeighborSearch(vector<double>{count + 5.0, count + 5.0}) == chain[count - 1]);
+        ASSERT_TRUE(kdTree->kNearest(last, 2)[1].node == chain[count - 2]);
+        ASSERT_EQ(kdTree->radiusCount(last, 1.5), 2u);
+        ASSERT_EQ(kdTree->rangeSearch(vector<double>{count - 10.0, 0.0}, last).size(), 10u);
+        ASSERT_EQ(kdTree->balanceReport().height, (unsigned int)count);
+        ASSERT_TRUE(kdTree->findMinimumAxisValueFromNode(nullptr, 1) == chain[0]);
+
+        kdTree->setSelfBalancing(true);
+        ASSERT_EQ(kdTree->getRoot()->getSubtreeSize(), (unsigned int)count);
+        kdTree->setSelfBalancing(false);
+
+        kdTree->removeNode(vector<double>{0.0, 0.0});
+        ASSERT_TRUE(kdTree->getNode(vector<double>{0.0, 0.0}) == nullptr);
+        ASSERT_TRUE(kdTree->getNode(last) != nullptr);
+        ASSERT_EQ(kdTree->getRoot()->getSubtreeSize(), (unsigned int)count - 1);
+    }
+}
+
+TEST_F(test_KDTree, KDTree_VisitorsStopEarly)
+{
+    {
+        vector<vector<double>> points = generate2DSpacePoints(2000);
+        KDTree *kdTree = new KDTree(2);
+        kdTree->build(points);
+        vector<double> minCorner = vector<double>{20.0, 20.0};
+        vector<double> maxCorner = vector<double>{70.0, 60.0};
+
+        vector<Node *> visited;
+        ASSERT_TRUE(kdTree->visitRange(minCorner, maxCorner, [&visited](Node *node) {
+            visited.push_back(node);
+            return true;
+        }));
+        ASSERT_TRUE(visited == kdTree->rangeSearch(minCorner, maxCorner));
+
+        size_t calls = 0;
+        ASSERT_FALSE(kdTree->visitRange(minCorner, maxCorner, [&calls](Node *) {
+            calls++;
+            return calls < 3;
+        }));
+        ASSERT_EQ(calls, 3u);
+
+        ASSERT_TRUE(kdTree->anyInRange(minCorner, maxCorner));
+        ASSERT_FALSE(kdTree->anyInRange(vector<double>{200.0, 200.0}, vector<double>{300.0, 300.0}));
+
+        vector<double> query = vector<double>{50.0, 50.0};
+        vector<KDTree::Neighbor> expected = kdTree->radiusSearch(query, 10.0);
+        vector<KDTree::Neighbor> actual;
+        ASSERT_TRUE(kdTree->visitRadius(query, 10.0, [&actual](Node *node, double distance) {
+            KDTree::Neighbor neighbor = {node, distance};
+            actual.push_back(neighbor);
+            return true;
+        }));
+        ASSERT_EQ(actual.size(), expected.size());
+        for (size_t i = 0; i < actual.size(); i++) {
+            ASSERT_TRUE(actual[i].node == expected[i].node);
+            ASSERT_DOUBLE_EQ(actual[i].distance, expected[i].distance);
+        }
+        ASSERT_FALSE(kdTree->visitRadius(query, 10.0, [](Node *, double) {
+            return false;
+        }) && !expected.empty());
+    }
+}
+
+TEST_F(test_KDTree, KDTree_RangeCursor)
+{
+    {
+        vector<vector<double>> points = generate2DSpacePoints(2000);
+        KDTree *kdTree = new KDTree(2);
+        kdTree->build(points);
+        vector<double> minCorner = vector<double>{15.0, 25.0};
+        vector<double> maxCorner = vector<double>{65.0, 80.0};
+        vector<Node *> expected = kdTree->rangeSearch(minCorner, maxCorner);
+        ASSERT_TRUE(expected.size() > 10);
+
+        vector<Node *> streamed;
+        for (Node *node : kdTree->rangeCursor(minCorner, maxCorner)) {
+            streamed.push_back(node);
+        }
+        ASSERT_TRUE(streamed == expected);
+
+        // stop after a few hits, then resume where the cursor left off
+        KDTree::RangeCursor cursor = kdTree->rangeCursor(minCorner, maxCorner);
+        vector<Node *> resumed;
+        for (int i = 0; i < 5; i++) {
+            resumed.push_back(cursor.next());
+        }
+        ASSERT_FALSE(cursor.isDone());
+        for (Node *node : cursor) {
+            resumed.push_back(node);
+        }
+        ASSERT_TRUE(resumed == expected);
+        ASSERT_TRUE(cursor.isDone());
+        ASSERT_TRUE(cursor.next() == nullptr);
+
+        KDTree::RangeCursor cancelled = kdTree->rangeCursor(minCorner, maxCorner);
+        ASSERT_TRUE(cancelled.next() == expected[0]);
+        cancelled.cancel();
+        ASSERT_TRUE(cancelled.next() == nullptr);
+
+        KDTree::RangeCursor empty = kdTree->rangeCursor(vector<double>{200.0, 200.0}, vector<double>{300.0, 300.0});
+        ASSERT_TRUE(empty.begin() == empty.end());
+        ASSERT_THROW(kdTree->rangeCursor(vector<double>{1.0}, maxCorner), invalid_argument);
+    }
+}
+
+TEST_F(test_KDTree, KDTree_Stats)
+{
+    {
+        vector<vector<double>> points = generate2DSpacePoints(1000);
+        KDTree *kdTree = new KDTree(2);
+        kdTree->build(points);
+
+        KDTree::TreeStats stats = kdTree->treeStats();
+        ASSERT_EQ(stats.size, (size_t)1000);
+        ASSERT_TRUE(stats.height >= stats.optimalHeight);
+        ASSERT_EQ(stats.depthHistogram.size(), (size_t)stats.height);
+        size_t total = 0;
+        for (size_t count : stats.depthHistogram) {
+            total += count;
+        }
+        ASSERT_EQ(total, stats.size);
+        ASSERT_EQ(stats.depthHistogram[0], (size_t)1);
+        ASSERT_EQ(stats.deadNodes, (size_t)0);
+        ASSERT_EQ(stats.memoryBytes, kdTree->memoryBytes());
+
+        kdTree->nearestNeighborSearch(vector<double>{33.3, 66.6});
+        KDTree::QueryStats query = KDTree::lastQueryStats();
+        if (KDTree::queryStatsEnabled()) {
+            ASSERT_TRUE(query.nodesVisited >= stats.height - 1);
+            ASSERT_TRUE(query.nodesVisited < stats.size);
+            ASSERT_EQ(query.distanceEvaluations, query.nodesVisited);
+            ASSERT_TRUE(query.maxDepth < stats.height);
+            ASSERT_TRUE(query.branchesPruned > 0);
+
+            // every query starts from zero, an empty box never leaves the root's path
+            kdTree->rangeSearch(vector<double>{200.0, 200.0}, vector<double>{300.0, 300.0});
+            query = KDTree::lastQueryStats();
+            ASSERT_TRUE(query.nodesVisited <= stats.height);
+            ASSERT_EQ(query.distanceEvaluations, (size_t)0);
+        } else {
+            ASSERT_EQ(query.nodesVisited, (size_t)0);
+            ASSERT_EQ(query.distanceEvaluations, (size_t)0);
+            ASSERT_EQ(query.branchesPruned, (size_t)0);
+        }
+    }
+}
+
+TEST_F(test_KDTree, KDTree_Ids)
+{
+    {
+        KDTree *kdTree = new KDTree(2);
+        ASSERT_EQ(kdTree->nearestNeighborId(vector<double>{1.0, 1.0}).id, KDTree::NO_ID);
+
+        // distinct points, so every point maps back to exactly one id
+        vector<vector<double>> points;
+        for (int i = 0; i < 500; i++) {
+            points.push_back(vector<double>{(double)((i * 37) % 500), (double)((i * 91) % 499)});
+        }
+        kdTree->build(points);
+        for (size_t i = 0; i < points.size(); i++) {
+            ASSERT_EQ(kdTree->getNodeId(points[i]), i);
+        }
+
+        // removal moves replacement points between nodes, their ids must move with them
+        for (size_t i = 0; i < points.size(); i += 3) {
+            kdTree->removeNode(points[i]);
+        }
+        for (size_t i = 0; i < points.size(); i++) {
+            ASSERT_EQ(kdTree->getNodeId(points[i]), i % 3 == 0 ? KDTree::NO_ID : i);
+        }
+
+        kdTree->insertNode(vector<double>{1000.0, 1000.0});
+        ASSERT_EQ(kdTree->getNodeId(vector<double>{1000.0, 1000.0}), points.size());
+        kdTree->insertNode(vector<double>{2000.0, 2000.0}, 9000);
+        kdTree->insertNode(vector<double>{3000.0, 3000.0});
+        ASSERT_EQ(kdTree->getNodeId(vector<double>{2000.0, 2000.0}), (size_t)9000);
+        ASSERT_EQ(kdTree->getNodeId(vector<double>{3000.0, 3000.0}), (size_t)9001);
+        ASSERT_THROW(kdTree->insertNode(vector<double>{1.0, 1.0}, KDTree::NO_ID), invalid_argument);
+
+        vector<double> query = vector<double>{250.5, 120.5};
+        vector<KDTree::Neighbor> neighbors = kdTree->kNearest(query, 7);
+        vector<KDTree::IdNeighbor> ids = kdTree->kNearestIds(query, 7);
+        ASSERT_EQ(ids.size(), neighbors.size());
+        for (size_t i = 0; i < ids.size(); i++) {
+            ASSERT_EQ(ids[i].id, neighbors[i].node->getId());
+            ASSERT_EQ(ids[i].distance, neighbors[i].distance);
+        }
+        KDTree::IdNeighbor nearest = kdTree->nearestNeighborId(query);
+        ASSERT_EQ(nearest.id, ids[0].id);
+        ASSERT_EQ(nearest.distance, ids[0].distance);
+
+        vector<KDTree::IdNeighbor> inBall = kdTree->radiusSearchIds(query, 60.0);
+        ASSERT_EQ(inBall.size(), kdTree->radiusCount(query, 60.0));
+        for (const KDTree::IdNeighbor &neighbor : inBall) {
+            double dx = points[neighbor.id][0] - query[0];
+            double dy = points[neighbor.id][1] - query[1];
+            ASSERT_EQ(neighbor.distance, sqrt(dx * dx + dy * dy));
+            ASSERT_TRUE(neighbor.distance <= 60.0);
+        }
+
+        vector<double> minCorner = vector<double>{100.0, 100.0};
+        vector<double> maxCorner = vector<double>{300.0, 250.0};
+        vector<Node *> nodes = kdTree->rangeSearch(minCorner, maxCorner);
+        vector<size_t> rangeIds = kdTree->rangeSearchIds(minCorner, maxCorner);
+        ASSERT_EQ(rangeIds.size(), nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            ASSERT_TRUE(nodes[i]->getPoint() == points[rangeIds[i]]);
+        }
+    }
+}
+
+TEST_F(test_KDTree, KDTree_DistanceJoin)
+{
+    {
+        vector<vector<double>> pings;
+        vector<vector<double>> stops;
+        for (int i = 0; i < 800; i++) {
+            pings.push_back(vector<double>{(double)((i * 7919) % 1000) / 10.0, (double)((i * 104729) % 997) / 10.0});
+        }
+        for (int i = 0; i < 300; i++) {
+            stops.push_back(vector<double>{(double)((i * 31) % 300) / 3.0, (double)((i * 577) % 293) / 2.93});
+        }
+        KDTree *a = new KDTree(2);
+        KDTree *b = new KDTree(2);
+        a->build(pings);
+        b->build(stops);
+        // a degenerate shape on one side must not change the pairs
+        b->insertNode(vector<double>{50.0, 50.0});
+        stops.push_back(vector<double>{50.0, 50.0});
+
+        const double epsilon = 2.5;
+        vector<pair<size_t, size_t>> expected;
+        for (size_t i = 0; i < pings.size(); i++) {
+            for (size_t j = 0; j < stops.size(); j++) {
+                double dx = pings[i][0] - stops[j][0];
+                double dy = pings[i][1] - stops[j][1];
+                if (sqrt(dx * dx + dy * dy) <= epsilon) {
+                    expected.push_back(make_pair(i, j));
+                }
+            }
+        }
+        ASSERT_TRUE(expected.size() > 50);
+
+        for (unsigned int threads : {1u, 4u}) {
+            mutex found;
+            vector<pair<size_t, size_t>> pairs;
+            a->distanceJoin(*b, epsilon, [&found, &pairs, epsilon](Node *ping, Node *stop, double distance) {
+                ASSERT_TRUE(distance <= epsilon);
+                lock_guard<mutex> lock(found);
+                pairs.push_back(make_pair(ping->getId(), stop->getId()));
+            }, threads);
+            sort(pairs.begin(), pairs.end());
+            ASSERT_TRUE(pairs == expected);
+        }
+
+        // tombstoned points take no part in the join
+        b->setLazyDeletion(true, 1.0);
+        b->removeNode(stops[expected[0].second]);
+        size_t joined = 0;
+        a->distanceJoin(*b, epsilon, [&joined](Node *, Node *, double) {
+            joined++;
+        });
+        size_t removed = 0;
+        for (const pair<size_t, size_t> &match : expected) {
+            removed += match.second == expected[0].second ? 1 : 0;
+        }
+        ASSERT_EQ(joined, expected.size() - removed);
+
+        KDTree *other = new KDTree(3);
+        ASSERT_THROW(a->distanceJoin(*other, epsilon, [](Node *, Node *, double) {}), invalid_argument);
+    }
+}